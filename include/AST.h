@@ -2,52 +2,88 @@
 #define AST_H
 #include <format>
 #include <memory>
-#include <memory>
+#include <span>
 #include <sstream>
 #include <string>
 #include <utility>
-#include <vector>
 
+#include "Arena.h"
+#include "Atom.h"
 #include "errors.h"
 #include "Scope.h"
+#include "Span.h"
 #include "Value.h"
 
 #include "magic_enum/magic_enum.hpp"
 
 namespace JS
 {
+    struct ParserOptions;
+
+    // Every node lives in the AST's arena and points at its children (and child lists) in the same arena.
+    // Nodes are never deleted on their own, so their destructors are left trivial and the whole tree goes away
+    // with the arena's chunks
     class AST
     {
     public:
 
+        // One per concrete node class, so passes can switch over a node instead of trying casts
+        enum class Kind : uint8_t
+        {
+            PARAMETER,
+            PROGRAM,
+            FUNCTION_CALL,
+            BINARY_EXPRESSION,
+            UNARY_EXPRESSION,
+            LITERAL,
+            VARIABLE_EXPRESSION,
+            VARIABLE_ASSIGNMENT,
+            BLOCK_STATEMENT,
+            FUNCTION_DECLARATION,
+            VARIABLE_DECLARATION,
+            IF_STATEMENT,
+            WHILE_STATEMENT,
+            FOR_STATEMENT,
+            RETURN_STATEMENT,
+            EXPRESSION_STATEMENT
+        };
+
         class Node
         {
         public:
-            virtual ~Node() = default;
+            [[nodiscard]] virtual Kind kind() const = 0;
             virtual std::string to_string() = 0;
+
+        protected:
+            ~Node() = default;
         };
 
         class Parameter final : public Node
         {
         public:
-            explicit Parameter(const std::string& name) : m_name(name) {}
+            [[nodiscard]] Kind kind() const override { return Kind::PARAMETER; }
+
+            explicit Parameter(const Atom name) : m_name(name) {}
 
             std::string to_string() override
             {
-                return std::format("Parameter [name={}]", m_name);
+                return std::format("Parameter [name={}]", m_name.name());
             }
 
+            [[nodiscard]] Atom name() const { return m_name; }
+
         private:
-            std::string m_name;
+            Atom m_name;
         };
 
+        class Statement;
+
         class Program final : public Node
         {
         public:
-            void add_statement(const std::shared_ptr<Node>& statement)
-            {
-                m_statements.push_back(statement);
-            }
+            [[nodiscard]] Kind kind() const override { return Kind::PROGRAM; }
+
+            explicit Program(const std::span<Statement* const> statements) : m_statements(statements) {}
 
             std::string to_string() override
             {
@@ -60,29 +96,29 @@ namespace JS
                 return std::format("Program [statements={}]", str.str());
             }
 
+            [[nodiscard]] std::span<Statement* const> statements() const { return m_statements; }
+
+            // The global scope, set by the Resolver
+            [[nodiscard]] ScopeInfo* scope() const { return m_scope; }
+            void set_scope(ScopeInfo* scope) { m_scope = scope; }
+
         private:
-            std::vector<std::shared_ptr<Node>> m_statements;
+            std::span<Statement* const> m_statements;
+            ScopeInfo* m_scope{nullptr};
         };
 
-        class Expression : public Node
-        {
-        public:
-            [[nodiscard]] virtual std::shared_ptr<Value> evaluate(std::shared_ptr<Scope> scope) const = 0;
-        };
+        class Expression : public Node {};
 
         class FunctionCall final : public Expression
         {
         public:
-            FunctionCall(std::string name, const std::vector<std::shared_ptr<Parameter>>& arguments) : m_name(std::move(name)),
+            [[nodiscard]] Kind kind() const override { return Kind::FUNCTION_CALL; }
+
+            FunctionCall(const Atom name, const std::span<Expression* const> arguments) : m_name(name),
                 m_arguments(arguments)
             {
             } // NOLINT(*-pass-by-value)
 
-            [[nodiscard]] std::shared_ptr<Value> evaluate(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
-            }
-
             std::string to_string() override
             {
                 std::ostringstream str;
@@ -91,18 +127,27 @@ namespace JS
                     str << arg->to_string() << ",";
                 }
 
-                return std::format("Function call [name={}, args={}]", m_name, str.str());
+                return std::format("Function call [name={}, args={}]", m_name.name(), str.str());
             }
 
+            [[nodiscard]] Atom name() const { return m_name; }
+            [[nodiscard]] std::span<Expression* const> arguments() const { return m_arguments; }
+
+            // Where the callee is, set by the Resolver
+            [[nodiscard]] const VariableLocation& location() const { return m_location; }
+            void set_location(const VariableLocation& location) { m_location = location; }
+
         private:
-            // TODO: switch to a flyweight string
-            std::string m_name;
-            std::vector<std::shared_ptr<Parameter>> m_arguments;
+            Atom m_name;
+            std::span<Expression* const> m_arguments;
+            VariableLocation m_location{};
         };
 
         class BinaryExpression final : public Expression
         {
         public:
+            [[nodiscard]] Kind kind() const override { return Kind::BINARY_EXPRESSION; }
+
             enum class Op
             {
                 PLUS,
@@ -117,110 +162,149 @@ namespace JS
                 EQUAL_EQUAL,
                 EQUAL_EQUAL_EQUAL,
                 NOT_EQUAL,
-                NOT_EQUAL_EQUAL
+                NOT_EQUAL_EQUAL,
+                LESS_THAN,
+                GREATER_THAN,
+                LESS_THAN_EQUAL_TO,
+                GREATER_THAN_EQUAL_TO,
+                SHIFT_LEFT,
+                SHIFT_RIGHT
             };
 
-            BinaryExpression(std::shared_ptr<Expression> left, std::shared_ptr<Expression> right, Op op) :
-                m_left(std::move(left)), m_right(std::move(right)), m_op(op) {}
+            BinaryExpression(Expression* left, Expression* right, Op op) :
+                m_left(left), m_right(right), m_op(op) {}
 
             std::string to_string() override
             {
                 return std::format("Binary Op [{} {} {}]", m_left->to_string(), magic_enum::enum_name(m_op), m_right->to_string());
             }
 
-            [[nodiscard]] std::shared_ptr<Value> evaluate(std::shared_ptr<Scope> scope) const override
+            [[nodiscard]] const Expression& left() const { return *m_left; }
+            [[nodiscard]] const Expression& right() const { return *m_right; }
+            [[nodiscard]] Op op() const { return m_op; }
+
+        private:
+            Expression* m_left;
+            Expression* m_right;
+            Op m_op;
+        };
+
+        class UnaryExpression final : public Expression
+        {
+        public:
+            [[nodiscard]] Kind kind() const override { return Kind::UNARY_EXPRESSION; }
+
+            enum class Op
             {
-                not_implemented();
+                MINUS,
+                PLUS,
+                NOT
+            };
+
+            UnaryExpression(Expression* operand, Op op) : m_operand(operand), m_op(op) {}
+
+            std::string to_string() override
+            {
+                return std::format("Unary Op [{} {}]", magic_enum::enum_name(m_op), m_operand->to_string());
             }
 
-            [[nodiscard]] const Expression& left() const { return *m_left; }
-            [[nodiscard]] const Expression& right() const { return *m_right; }
+            [[nodiscard]] const Expression& operand() const { return *m_operand; }
             [[nodiscard]] Op op() const { return m_op; }
 
         private:
-            std::shared_ptr<Expression> m_left;
-            std::shared_ptr<Expression> m_right;
+            Expression* m_operand;
             Op m_op;
         };
 
         class Literal final : public Expression
         {
         public:
-            explicit Literal(const std::shared_ptr<Value>& value) : m_value(value)
+            [[nodiscard]] Kind kind() const override { return Kind::LITERAL; }
+
+            // The tree outlives any heap, so a string folded while a VM is running is interned rather than kept in
+            // its heap
+            explicit Literal(const Value value) : m_value(value.is<StringCell>() ? Value(AtomTable::the().intern(value.as<std::string_view>())) : value)
             {
             }
 
-            [[nodiscard]] std::shared_ptr<Value> evaluate(std::shared_ptr<Scope> scope) const override { return m_value; }
-
             std::string to_string() override
             {
-                return std::format("Literal [{}]", m_value->to_string());
+                return std::format("Literal [{}]", m_value.to_string());
             }
 
+            [[nodiscard]] const Value& value() const { return m_value; }
+
         private:
-            std::shared_ptr<Value> m_value;
+            Value m_value;
         };
 
         class VariableExpression final : public Expression
         {
         public:
-            explicit VariableExpression(const std::string& name) : m_name(name) {}
+            [[nodiscard]] Kind kind() const override { return Kind::VARIABLE_EXPRESSION; }
 
-            [[nodiscard]] std::shared_ptr<Value> evaluate(std::shared_ptr<Scope> scope) const override { not_implemented(); }
+            explicit VariableExpression(const Atom name) : m_name(name) {}
 
             std::string to_string() override
             {
-                return std::format("Variable [name={}]", m_name);
+                if(m_location.is_resolved())
+                {
+                    return std::format("Variable [name={}, hops={}, slot={}]", m_name.name(), m_location.hops, m_location.slot);
+                }
+                return std::format("Variable [name={}]", m_name.name());
             }
 
+            [[nodiscard]] Atom name() const { return m_name; }
+
+            // Set by the Resolver
+            [[nodiscard]] const VariableLocation& location() const { return m_location; }
+            void set_location(const VariableLocation& location) { m_location = location; }
+
         private:
-            std::string m_name;
+            Atom m_name;
+            VariableLocation m_location{};
         };
 
         class VariableAssignment final : public Expression
         {
         public:
-            VariableAssignment(std::string name, const std::shared_ptr<Value>& value) : m_name(std::move(name)), m_value(value) {}
+            [[nodiscard]] Kind kind() const override { return Kind::VARIABLE_ASSIGNMENT; }
 
-            [[nodiscard]] std::shared_ptr<Value> evaluate(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
-            }
+            VariableAssignment(const Atom name, Expression* value) : m_name(name), m_value(value) {}
 
             std::string to_string() override
             {
-                return std::format("VariableAssignment [{}={}]", m_name, m_value->to_string());
+                return std::format("VariableAssignment [{}={}]", m_name.name(), m_value->to_string());
             }
 
+            [[nodiscard]] Atom name() const { return m_name; }
+            [[nodiscard]] const Expression& value() const { return *m_value; }
+
+            // Set by the Resolver
+            [[nodiscard]] const VariableLocation& location() const { return m_location; }
+            void set_location(const VariableLocation& location) { m_location = location; }
+
         private:
-            std::string m_name;
-            std::shared_ptr<Value> m_value;
+            Atom m_name;
+            Expression* m_value;
+            VariableLocation m_location{};
         };
 
-        class Statement : public Node
-        {
-        public:
-            virtual void execute(std::shared_ptr<Scope> scope) const = 0;
-        };
+        class Statement : public Node {};
 
         class BlockStatement final : public Statement
         {
         public:
+            [[nodiscard]] Kind kind() const override { return Kind::BLOCK_STATEMENT; }
 
-            explicit BlockStatement(const std::vector<std::shared_ptr<Statement>>& statements)
-            {
-                m_statements = std::vector(statements);
-            }
+            explicit BlockStatement(const std::span<Statement* const> statements) : m_statements(statements) {}
 
-            void add_statement(const std::shared_ptr<Statement>& statement)
-            {
-                m_statements.push_back(statement);
-            }
+            [[nodiscard]] std::span<Statement* const> statements() const { return m_statements; }
 
-            void execute(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
-            }
+            // Set by the Resolver if the block declares anything with let, const or function; a block that doesn't
+            // has no scope of its own at runtime. A function's body block never has one, the function's scope is used
+            [[nodiscard]] ScopeInfo* scope() const { return m_scope; }
+            void set_scope(ScopeInfo* scope) { m_scope = scope; }
 
             std::string to_string() override
             {
@@ -235,153 +319,217 @@ namespace JS
             }
 
         private:
-            std::vector<std::shared_ptr<Statement>> m_statements;
+            std::span<Statement* const> m_statements;
+            ScopeInfo* m_scope{nullptr};
         };
 
         class FunctionDeclaration final : public Statement
         {
         public:
+            [[nodiscard]] Kind kind() const override { return Kind::FUNCTION_DECLARATION; }
 
-            FunctionDeclaration(std::string name, const std::vector<std::shared_ptr<Parameter>>& parameters, std::shared_ptr<BlockStatement> body) : m_name(std::move(name)), m_parameters(parameters), m_body(body) {}
+            FunctionDeclaration(const Atom name, const std::span<Parameter* const> parameters, BlockStatement* body) : m_name(name), m_parameters(parameters), m_body(body) {}
+
+            // A pre-parsed declaration whose body is only checked for balanced brackets. It is parsed into arena
+            // with options the first time body() is asked for; body_offset is where its opening brace is relative to
+            // span().start. free_names holds every identifier in the body, a superset of the outer variables it can
+            // refer to. options must live as long as the tree
+            FunctionDeclaration(const Atom name, const std::span<Parameter* const> parameters, Arena& arena, const uint32_t body_offset, const std::span<const Atom> free_names, const ParserOptions& options)
+                : m_name(name), m_parameters(parameters), m_body(nullptr), m_arena(&arena), m_options(&options), m_body_offset(body_offset), m_free_names(free_names) {}
 
             std::string to_string() override
             {
-                return std::format("FunctionDeclaration[name={}, arg_count={}, body={}]", m_name, m_parameters.size(), m_body->to_string());
+                return std::format("FunctionDeclaration[name={}, arg_count={}, body={}]", m_name.name(), m_parameters.size(), m_body ? m_body->to_string() : "[not parsed]");
             }
 
-            void execute(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
-            }
+            // Parses a lazy body on first use (the first call of the function), so the file must still hold the
+            // text the declaration was parsed from. Not safe to race with itself
+            [[nodiscard]] BlockStatement* body() const;
+            [[nodiscard]] bool is_body_parsed() const { return m_body; }
+            void set_body(BlockStatement* body) { m_body = body; }
+
+            // Pre-parsed, whether or not body() has parsed it since
+            [[nodiscard]] bool is_lazy() const { return m_arena; }
+            [[nodiscard]] uint32_t body_offset() const { return m_body_offset; }
+
+            // From the function keyword through the closing brace, used to reuse the declaration across edits
+            [[nodiscard]] const Span& span() const { return m_span; }
+            void set_span(const Span& span) { m_span = span; }
+
+            [[nodiscard]] Atom name() const { return m_name; }
+            [[nodiscard]] std::span<Parameter* const> parameters() const { return m_parameters; }
+            [[nodiscard]] std::span<const Atom> free_names() const { return m_free_names; }
+
+            // Set by the Resolver: where the function's name is bound, the scope it was declared in, and its own
+            // scope (parameters first). A body that isn't parsed yet is resolved when it is, and has no scope until then
+            [[nodiscard]] const VariableLocation& location() const { return m_location; }
+            void set_location(const VariableLocation& location) { m_location = location; }
+            [[nodiscard]] ScopeInfo* enclosing_scope() const { return m_enclosing_scope; }
+            void set_enclosing_scope(ScopeInfo* scope) { m_enclosing_scope = scope; }
+            [[nodiscard]] ScopeInfo* scope() const { return m_scope; }
+            void set_scope(ScopeInfo* scope) { m_scope = scope; }
 
         private:
-            std::string m_name;
-            std::vector<std::shared_ptr<Parameter>> m_parameters;
-            std::shared_ptr<BlockStatement> m_body;
+            Atom m_name;
+            std::span<Parameter* const> m_parameters;
+            mutable BlockStatement* m_body;
+            Arena* m_arena{nullptr};
+            const ParserOptions* m_options{nullptr};
+            uint32_t m_body_offset{0};
+            std::span<const Atom> m_free_names;
+            VariableLocation m_location{};
+            ScopeInfo* m_enclosing_scope{nullptr};
+            ScopeInfo* m_scope{nullptr};
+            Span m_span{};
         };
 
         class VariableDeclaration final : public Statement
         {
         public:
+            [[nodiscard]] Kind kind() const override { return Kind::VARIABLE_DECLARATION; }
+
+            enum class DeclarationKind : uint8_t
+            {
+                VAR,
+                LET,
+                CONST
+            };
 
-            VariableDeclaration(std::string name, const std::shared_ptr<Value>& initial_value) : m_name(std::move(name)), m_initial_value(initial_value) {}
+            // initial_value is null for a declaration without an initializer
+            VariableDeclaration(const DeclarationKind declaration_kind, const Atom name, Expression* initial_value) : m_declaration_kind(declaration_kind), m_name(name), m_initial_value(initial_value) {}
 
             std::string to_string() override;
-            void execute(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
-            }
+
+            [[nodiscard]] DeclarationKind declaration_kind() const { return m_declaration_kind; }
+            [[nodiscard]] Atom name() const { return m_name; }
+            [[nodiscard]] const Expression* initial_value() const { return m_initial_value; }
+
+            // Set by the Resolver
+            [[nodiscard]] const VariableLocation& location() const { return m_location; }
+            void set_location(const VariableLocation& location) { m_location = location; }
 
         private:
-            std::string m_name;
-            std::shared_ptr<Value> m_initial_value;
+            DeclarationKind m_declaration_kind;
+            Atom m_name;
+            Expression* m_initial_value;
+            VariableLocation m_location{};
         };
 
         class IfStatement final : public Statement
         {
         public:
+            [[nodiscard]] Kind kind() const override { return Kind::IF_STATEMENT; }
 
-            IfStatement(const std::shared_ptr<Expression>& condition, const std::shared_ptr<BlockStatement>& body) : m_condition(condition), m_body(body) {}
+            // alternate is the else branch, null if there is none
+            IfStatement(Expression* condition, BlockStatement* body,
+                        BlockStatement* alternate = nullptr) : m_condition(condition), m_body(body), m_alternate(alternate) {}
 
             std::string to_string() override
             {
+                if(m_alternate)
+                {
+                    return std::format("IfStatement [condition={}, body={}, else={}]", m_condition->to_string(), m_body->to_string(), m_alternate->to_string());
+                }
                 return std::format("IfStatement [condition={}, body={}]", m_condition->to_string(), m_body->to_string());
             }
 
-            void execute(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
-            }
+            [[nodiscard]] const Expression& condition() const { return *m_condition; }
+            [[nodiscard]] const BlockStatement& body() const { return *m_body; }
+            [[nodiscard]] const BlockStatement* alternate() const { return m_alternate; }
 
         private:
-            std::shared_ptr<Expression> m_condition;
-            std::shared_ptr<BlockStatement> m_body;
+            Expression* m_condition;
+            BlockStatement* m_body;
+            BlockStatement* m_alternate;
         };
 
         class WhileStatement final : public Statement
         {
         public:
+            [[nodiscard]] Kind kind() const override { return Kind::WHILE_STATEMENT; }
 
-            WhileStatement(const std::shared_ptr<Expression>& condition, const std::shared_ptr<BlockStatement>& body) : m_condition(condition), m_body(body) {}
+            WhileStatement(Expression* condition, BlockStatement* body) : m_condition(condition), m_body(body) {}
 
             std::string to_string() override
             {
                 return std::format("WhileStatement [condition={}, body={}]", m_condition->to_string(), m_body->to_string());
             }
 
-            void execute(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
-            }
+            [[nodiscard]] const Expression& condition() const { return *m_condition; }
+            [[nodiscard]] const BlockStatement& body() const { return *m_body; }
 
         private:
-            std::shared_ptr<Expression> m_condition;
-            std::shared_ptr<BlockStatement> m_body;
+            Expression* m_condition;
+            BlockStatement* m_body;
         };
 
         class ForStatement final : public Statement
         {
         public:
+            [[nodiscard]] Kind kind() const override { return Kind::FOR_STATEMENT; }
 
-            ForStatement(const std::shared_ptr<Expression>& condition, const std::shared_ptr<BlockStatement>& body) : m_condition(condition), m_body(body) {}
+            ForStatement(Expression* condition, BlockStatement* body) : m_condition(condition), m_body(body) {}
 
             std::string to_string() override
             {
                 return std::format("ForStatement [condition={}, body={}]", m_condition->to_string(), m_body->to_string());
             }
 
-            void execute(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
-            }
+            [[nodiscard]] const Expression& condition() const { return *m_condition; }
+            [[nodiscard]] const BlockStatement& body() const { return *m_body; }
 
         private:
-            std::shared_ptr<Expression> m_condition;
-            std::shared_ptr<BlockStatement> m_body;
+            Expression* m_condition;
+            BlockStatement* m_body;
         };
 
         class ReturnStatement final : public Statement
         {
         public:
+            [[nodiscard]] Kind kind() const override { return Kind::RETURN_STATEMENT; }
+
+            // value is null for a bare return
+            explicit ReturnStatement(Expression* value) : m_value(value) {}
+
             std::string to_string() override
             {
-                return "ReturnStatement";
-            }
-            void execute(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
+                return std::format("ReturnStatement [value={}]", m_value ? m_value->to_string() : "undefined");
             }
+
+            [[nodiscard]] const Expression* value() const { return m_value; }
+
+        private:
+            Expression* m_value;
         };
 
-        class FunctionCallStatement final : public Statement
+        class ExpressionStatement final : public Statement
         {
         public:
+            [[nodiscard]] Kind kind() const override { return Kind::EXPRESSION_STATEMENT; }
 
-            FunctionCallStatement(const std::shared_ptr<FunctionCall>& function_call) : m_function_call(function_call) {}
+            explicit ExpressionStatement(Expression* expression) : m_expression(expression) {}
 
             std::string to_string() override
             {
-                return std::format("FunctionCallStatement [function_call={}]", m_function_call->to_string());
+                return std::format("ExpressionStatement [expression={}]", m_expression->to_string());
             }
 
-            void execute(std::shared_ptr<Scope> scope) const override
-            {
-                not_implemented();
-            }
+            [[nodiscard]] const Expression& expression() const { return *m_expression; }
+
         private:
-            std::shared_ptr<FunctionCall> m_function_call;
+            Expression* m_expression;
         };
 
         //TODO: missing switch statement, import statement, class declarations
 
-        AST(const std::shared_ptr<Program>& program, const std::shared_ptr<Scope>& global_scope) : m_program(program), m_global_scope(global_scope) {}
-        void execute();
+        AST(const std::shared_ptr<Arena>& arena, Program* program) : m_arena(arena), m_program(program) {}
 
-        [[nodiscard]] std::shared_ptr<Program> program() const { return m_program; }
+        [[nodiscard]] Program* program() const { return m_program; }
+        [[nodiscard]] const std::shared_ptr<Arena>& arena() const { return m_arena; }
 
     private:
-        std::shared_ptr<Program> m_program;
-        std::shared_ptr<Scope> m_global_scope;
+        std::shared_ptr<Arena> m_arena;
+        Program* m_program;
     };
 }
 
@@ -0,0 +1,96 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace JS
+{
+    // Bump allocator that owns everything made in it until it is destroyed, which frees whole chunks at once.
+    // Objects are never destroyed one by one: trivially destructible ones cost nothing at teardown, the rest
+    // have their destructor queued and run when the arena goes away
+    class Arena final
+    {
+    public:
+        Arena() = default;
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        ~Arena();
+
+        template <typename T, typename... Args>
+        T* make(Args&&... args)
+        {
+            T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if constexpr (!std::is_trivially_destructible_v<T>)
+            {
+                m_finalizers.push_back({object, [](void* pointer) { static_cast<T*>(pointer)->~T(); }});
+            }
+
+            return object;
+        }
+
+        // Copies items into the arena; the result lives as long as the arena does
+        template <typename T>
+        std::span<T> copy(const std::span<const T> items)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (items.empty())
+            {
+                return {};
+            }
+
+            auto* destination = static_cast<T*>(allocate(items.size_bytes(), alignof(T)));
+            std::memcpy(destination, items.data(), items.size_bytes());
+            return {destination, items.size()};
+        }
+
+        // Keeps other alive for as long as this arena, for objects here that point into it
+        void retain(std::shared_ptr<const Arena> other) { m_retained.push_back(std::move(other)); }
+
+        [[nodiscard]] size_t bytes_allocated() const { return m_bytes_allocated; }
+
+    private:
+        // Chunks start small so tiny scripts stay cheap and double up to the cap as the tree grows
+        static constexpr size_t min_chunk_size = 16 * 1024;
+        static constexpr size_t max_chunk_size = 1024 * 1024;
+
+        void* allocate(const size_t size, const size_t alignment)
+        {
+            auto cursor = (reinterpret_cast<uintptr_t>(m_cursor) + alignment - 1) & ~(alignment - 1);
+            if (cursor + size > reinterpret_cast<uintptr_t>(m_end))
+            {
+                return allocate_slow(size, alignment);
+            }
+
+            m_cursor = reinterpret_cast<std::byte*>(cursor + size);
+            m_bytes_allocated += size;
+            return reinterpret_cast<void*>(cursor);
+        }
+
+        void* allocate_slow(size_t size, size_t alignment);
+
+        struct Finalizer
+        {
+            void* object;
+            void (*destroy)(void*);
+        };
+
+        std::vector<std::unique_ptr<std::byte[]>> m_chunks;
+        std::byte* m_cursor{nullptr};
+        std::byte* m_end{nullptr};
+        size_t m_next_chunk_size{min_chunk_size};
+        size_t m_bytes_allocated{0};
+
+        std::vector<Finalizer> m_finalizers;
+        std::vector<std::shared_ptr<const Arena>> m_retained;
+    };
+}
+
+#endif //ARENA_H
@@ -0,0 +1,96 @@
+#ifndef ATOM_H
+#define ATOM_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace JS
+{
+    // An interned identifier: comparing, hashing and copying one is integer work. Atom{} is the empty string
+    class Atom
+    {
+    public:
+        constexpr Atom() = default;
+        constexpr explicit Atom(const uint32_t id) : m_id(id) {}
+
+        [[nodiscard]] constexpr uint32_t id() const { return m_id; }
+        [[nodiscard]] std::string_view name() const;
+        [[nodiscard]] uint32_t hash() const;
+
+        constexpr bool operator==(const Atom&) const = default;
+
+    private:
+        uint32_t m_id{0};
+    };
+
+    // Safe to use from several threads: interning takes a lock, reading an atom's name or hash never does
+    class AtomTable final
+    {
+    public:
+        static AtomTable& the()
+        {
+            // Lexer workers may be the first to intern, so this has to be initialized thread-safely
+            static AtomTable table;
+            return table;
+        }
+
+        Atom intern(std::string_view name);
+
+        [[nodiscard]] std::string_view name(const Atom atom) const { return entry(atom).name; }
+        [[nodiscard]] uint32_t hash(const Atom atom) const { return entry(atom).hash; }
+
+        static uint32_t hash(std::string_view name);
+
+    private:
+        AtomTable();
+        AtomTable(AtomTable&&) = delete;
+        AtomTable(AtomTable&) = delete;
+
+        struct Entry
+        {
+            std::string_view name;
+            uint32_t hash;
+        };
+
+        struct EntryHash
+        {
+            size_t operator()(const std::string_view name) const { return AtomTable::hash(name); }
+        };
+
+        // Entries live in fixed-size segments that never move once allocated, so readers can index them without
+        // synchronizing with a concurrent intern()
+        static constexpr uint32_t segment_bits = 16;
+        static constexpr uint32_t segment_size = 1u << segment_bits;
+        static constexpr size_t segment_count = (1ull << 32) / segment_size;
+
+        [[nodiscard]] const Entry& entry(const Atom atom) const
+        {
+            return m_segments[atom.id() >> segment_bits].load(std::memory_order_acquire)[atom.id() & (segment_size - 1)];
+        }
+
+        std::shared_mutex m_mutex;
+        // Deque so the views in the entries and m_ids stay valid as names are added
+        std::deque<std::string> m_names;
+        std::array<std::atomic<Entry*>, segment_count> m_segments{};
+        uint32_t m_count{0};
+        std::unordered_map<std::string_view, uint32_t, EntryHash> m_ids;
+    };
+
+    inline std::string_view Atom::name() const { return AtomTable::the().name(*this); }
+    inline uint32_t Atom::hash() const { return AtomTable::the().hash(*this); }
+}
+
+template <>
+struct std::hash<JS::Atom>
+{
+    size_t operator()(const JS::Atom atom) const noexcept { return atom.hash(); }
+};
+
+#endif //ATOM_H
@@ -0,0 +1,120 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AST.h"
+#include "Heap.h"
+#include "Scope.h"
+#include "Value.h"
+
+namespace JS
+{
+    // Every opcode with its operand count. An instruction is a word holding its opcode followed by one word per
+    // operand. Operands are registers of the current frame (r), constant pool indices (k), indices into the nested
+    // functions (f), code offsets (@), scope chain hops and slots, or atom ids
+#define ENUMERATE_OPCODES(OPCODE) \
+    OPCODE(LOAD_CONSTANT, 2)            /* r <- k */ \
+    OPCODE(LOAD_UNDEFINED, 1)           /* r <- undefined */ \
+    OPCODE(MOVE, 2)                     /* r <- r */ \
+    OPCODE(GET_SCOPE, 3)                /* r <- hops, slot */ \
+    OPCODE(SET_SCOPE, 3)                /* hops, slot <- r */ \
+    OPCODE(GET_GLOBAL, 2)               /* r <- atom */ \
+    OPCODE(SET_GLOBAL, 2)               /* atom <- r */ \
+    OPCODE(PUSH_SCOPE, 1)               /* slot count */ \
+    OPCODE(POP_SCOPE, 0) \
+    OPCODE(MAKE_CLOSURE, 2)             /* r <- f */ \
+    \
+    OPCODE(ADD, 3)                      /* r <- r + r */ \
+    OPCODE(SUBTRACT, 3) \
+    OPCODE(MULTIPLY, 3) \
+    OPCODE(DIVIDE, 3) \
+    OPCODE(MODULO, 3) \
+    OPCODE(BITWISE_AND, 3) \
+    OPCODE(BITWISE_OR, 3) \
+    OPCODE(BITWISE_XOR, 3) \
+    OPCODE(SHIFT_LEFT, 3) \
+    OPCODE(SHIFT_RIGHT, 3) \
+    OPCODE(LOOSELY_EQUAL, 3) \
+    OPCODE(LOOSELY_NOT_EQUAL, 3) \
+    OPCODE(STRICTLY_EQUAL, 3) \
+    OPCODE(STRICTLY_NOT_EQUAL, 3) \
+    OPCODE(LESS_THAN, 3) \
+    OPCODE(GREATER_THAN, 3) \
+    OPCODE(LESS_THAN_EQUAL_TO, 3) \
+    OPCODE(GREATER_THAN_EQUAL_TO, 3) \
+    OPCODE(NEGATE, 2)                   /* r <- -r */ \
+    OPCODE(TO_NUMBER, 2)                /* r <- +r */ \
+    OPCODE(NOT, 2)                      /* r <- !r */ \
+    \
+    OPCODE(JUMP, 1)                     /* @ */ \
+    OPCODE(JUMP_IF_FALSE, 2)            /* r, @ */ \
+    OPCODE(CALL, 4)                     /* r <- r(first r, argument count) */ \
+    OPCODE(RETURN, 1)                   /* r */ \
+    OPCODE(RETURN_UNDEFINED, 0)
+
+    enum class Opcode : uint32_t
+    {
+#define OPCODE(name, operands) name,
+        ENUMERATE_OPCODES(OPCODE)
+#undef OPCODE
+    };
+
+    inline constexpr std::array opcode_operand_counts = {
+#define OPCODE(name, operands) uint8_t{operands},
+        ENUMERATE_OPCODES(OPCODE)
+#undef OPCODE
+    };
+
+    inline constexpr std::array opcode_names = {
+#define OPCODE(name, operands) std::string_view(#name),
+        ENUMERATE_OPCODES(OPCODE)
+#undef OPCODE
+    };
+
+    // The bytecode of the program's top level or of one function declaration. A function's code is compiled the
+    // first time it is called, so a body that is never called is never parsed or compiled either
+    struct FunctionCode
+    {
+        // Null for the program
+        const AST::FunctionDeclaration* declaration{nullptr};
+
+        std::vector<uint32_t> code;
+        // code with each opcode replaced by the offset of its handler, made by a VM built with threaded dispatch
+        // the first time the function runs
+        std::vector<uint32_t> threaded_code;
+        std::vector<Value> constants;
+        // Function declarations directly inside this one, in the order MAKE_CLOSURE refers to them
+        std::vector<std::unique_ptr<FunctionCode>> functions;
+
+        // Registers the frame needs. The first parameter_count hold the arguments
+        uint32_t register_count{0};
+        uint32_t parameter_count{0};
+
+        [[nodiscard]] bool is_compiled() const { return !code.empty(); }
+        [[nodiscard]] std::string name() const { return declaration ? std::string(declaration->name().name()) : "[program]"; }
+
+        // One instruction per line, for debugging the compiler
+        [[nodiscard]] std::string to_string() const;
+    };
+
+    // A function value: its code and the runtime scope it was declared in
+    struct Closure final : Cell
+    {
+        static constexpr auto cell_kind = Kind::CLOSURE;
+        Closure(FunctionCode* function, Scope* scope) : Cell(cell_kind), function(function), scope(scope) {}
+
+        void visit_edges(Tracer& tracer) override { tracer.visit(scope); }
+        Cell* promote() override { return new Closure(std::move(*this)); }
+
+        FunctionCode* function;
+        Scope* scope;
+    };
+}
+
+#endif //BYTECODE_H
@@ -0,0 +1,21 @@
+#ifndef CHAR_SCAN_H
+#define CHAR_SCAN_H
+
+namespace JS::CharScan
+{
+    // Bulk scanners for the lexer's hot loops. Each takes [cursor, end) and returns the first position that
+    // doesn't belong to the run (or end). They process 32 bytes per step with AVX2, 16 with SSE2, and fall back
+    // to a byte loop for the tail and on targets without either.
+
+    // Spaces, tabs, newlines, carriage returns, vertical tabs and form feeds
+    const char* skip_whitespace(const char* cursor, const char* end);
+
+    // [A-Za-z0-9_$]
+    const char* skip_identifier(const char* cursor, const char* end);
+
+    // Stops on the closing quote, on a backslash that needs decoding, or on a line break, which ends an
+    // unterminated string
+    const char* find_string_stop(const char* cursor, const char* end, char quote);
+}
+
+#endif //CHAR_SCAN_H
@@ -0,0 +1,107 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "AST.h"
+#include "Bytecode.h"
+#include "FlatAST.h"
+#include "Scope.h"
+
+namespace JS
+{
+    // Compiles a resolved tree to register bytecode. Each binding of the function's own scopes gets a register,
+    // except captured ones, which live in a runtime Scope; the Resolver's (hops, slot) locations are turned into one
+    // or the other here. Temporaries are allocated above the bindings and released after each statement. Each unit
+    // is flattened first (see FlatAST) and compiled from that
+    class Compiler
+    {
+    public:
+        // The program's top-level code. The tree must outlive the code, nested functions refer back into it
+        static std::unique_ptr<FunctionCode> compile(const AST& ast);
+        // A function's code, compiled on its first call. Parses the body if it hasn't been yet
+        static void compile_function(FunctionCode& function);
+
+    private:
+        using Index = FlatAST::Index;
+
+        Compiler(FunctionCode& function, const FlatAST& ast) : m_function(function), m_ast(ast) {}
+
+        // Where a variable is, from the scopes the compiler is in
+        struct Place
+        {
+            enum class Kind : uint8_t
+            {
+                REGISTER,
+                SCOPE,
+                GLOBAL
+            };
+
+            Kind kind;
+            // The register, the scope hops or the atom id
+            uint32_t index;
+            uint32_t slot{0};
+        };
+
+        void compile_program();
+        void compile_function_body(const AST::FunctionDeclaration& declaration);
+
+        // Gives the scope's bindings registers (and a runtime Scope if any are captured), then declares the
+        // function declarations among statements, which are hoisted to the top of it
+        void enter_scope(const ScopeInfo& scope, std::span<const Index> statements);
+        void exit_scope();
+
+        void compile_statements(std::span<const Index> statements);
+        void compile_statement(Index statement);
+        void compile_block(Index block);
+
+        // The register holding the expression's value: into if given, otherwise a temporary or the register of
+        // the variable it reads, which the caller must not write to
+        uint32_t compile_expression(Index expression, std::optional<uint32_t> into = {});
+        uint32_t compile_binary_expression(Index expression, std::optional<uint32_t> into);
+        uint32_t compile_function_call(Index call, std::optional<uint32_t> into);
+        uint32_t load(const Place& place, std::optional<uint32_t> into);
+        // Stores the expression's value in place, returning the register it was computed in
+        uint32_t store(const Place& place, Index value, std::optional<uint32_t> into);
+        void store(const Place& place, uint32_t value);
+
+        // Of a node with a name atom in a and a location in c
+        [[nodiscard]] Place place_of(const FlatAST::Node& node) const;
+        [[nodiscard]] Place place_of(Atom name, const VariableLocation& location) const;
+
+        // A register that read a variable may be written by an assignment in a later operand; reads that have to
+        // survive one are copied to a temporary first
+        uint32_t protect(uint32_t value, Index later);
+
+        uint32_t allocate_register();
+        uint32_t add_constant(const Value& value);
+        void emit(Opcode opcode, std::initializer_list<uint32_t> operands = {});
+        // Emits a jump with a placeholder target and returns where the target goes, see patch()
+        size_t emit_jump(Opcode opcode, std::initializer_list<uint32_t> operands = {});
+        void patch(size_t jump);
+
+        FunctionCode& m_function;
+        const FlatAST& m_ast;
+
+        struct ScopeRegisters
+        {
+            const ScopeInfo* scope;
+            uint32_t first_register;
+            // m_first_temporary outside the scope
+            uint32_t first_temporary;
+        };
+        // The scopes of this function the compiler is in, innermost last
+        std::vector<ScopeRegisters> m_scopes;
+
+        uint32_t m_next_register{0};
+        // Registers below this hold bindings, the rest are temporaries of the statement being compiled
+        uint32_t m_first_temporary{0};
+
+        std::vector<Index> m_expression_stack;
+    };
+}
+
+#endif //COMPILER_H
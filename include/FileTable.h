@@ -0,0 +1,97 @@
+#ifndef FILE_TABLE_H
+#define FILE_TABLE_H
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SourceBuffer.h"
+
+namespace JS
+{
+    using FileId = uint16_t;
+
+    struct FilePosition
+    {
+        size_t line;
+        size_t column;
+        size_t character_index;
+    };
+
+    // removed_length bytes at start were replaced by inserted_length new ones
+    struct TextEdit
+    {
+        uint32_t start;
+        uint32_t removed_length;
+        uint32_t inserted_length;
+
+        [[nodiscard]] int64_t delta() const { return static_cast<int64_t>(inserted_length) - removed_length; }
+    };
+
+    // Token payloads that can't be expressed as a slice of the source. Tokens refer to these by index;
+    // cooked_strings is a deque so views of earlier entries survive later insertions
+    struct TokenPayloads
+    {
+        std::deque<std::string> cooked_strings;
+        std::vector<double> numbers;
+    };
+
+    struct SourceFile
+    {
+        std::string name;
+        std::span<const char> source;
+        // Set when the table owns the bytes, so every token pointing into them stays valid as long as the file is
+        // registered
+        std::optional<SourceBuffer> owned_source;
+
+        TokenPayloads payloads;
+
+        // Byte offset of the first character of every line, built once when the file is added
+        std::vector<uint32_t> line_starts;
+
+        [[nodiscard]] std::string_view slice(const uint32_t offset, const uint32_t length) const
+        {
+            return {source.data() + offset, length};
+        }
+
+        [[nodiscard]] FilePosition position_of(uint32_t offset) const;
+
+        void build_line_starts();
+    };
+
+    // Every source file the engine has seen. Tokens and spans carry a FileId into this table instead of a copy
+    // of the file name, and everything a token points at (the source bytes, decoded payloads) lives here
+    class FileTable final
+    {
+    public:
+        static FileTable& the()
+        {
+            static FileTable table;
+            return table;
+        }
+
+        // The caller keeps source alive for as long as tokens from it are in use
+        FileId add(std::string name, std::span<const char> source);
+        FileId add(std::string name, SourceBuffer source);
+
+        // Swaps in the edited contents of a file. Payload tables are kept (they only ever grow), so tokens lexed
+        // from the old contents stay valid once their offsets are adjusted, see Lexer::relex
+        void replace(FileId id, std::span<const char> source);
+        void replace(FileId id, SourceBuffer source);
+
+        [[nodiscard]] SourceFile& file(const FileId id) { return m_files[id]; }
+
+    private:
+        FileTable() = default;
+        FileTable(FileTable&&) = delete;
+        FileTable(FileTable&) = delete;
+
+        std::deque<SourceFile> m_files;
+    };
+}
+
+#endif //FILE_TABLE_H
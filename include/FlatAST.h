@@ -0,0 +1,91 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "AST.h"
+#include "Atom.h"
+#include "Scope.h"
+#include "Value.h"
+
+namespace JS
+{
+    // One compilation unit of a resolved tree (the program's top level, or one function's body) packed into an
+    // array of 16-byte nodes that refer to each other by index, with the Resolver's annotations in side tables.
+    // Nodes are laid out in post-order (children before parents, the root last), so a bottom-up pass is a single
+    // forward sweep. Lists (block statements, call arguments) are contiguous ranges of m_lists, prefixed by their
+    // length. Nested function declarations are left as references to the tree: their bodies may not be parsed yet,
+    // and each is flattened on its own when it is compiled
+    class FlatAST
+    {
+    public:
+        using Index = uint32_t;
+        static constexpr Index none = std::numeric_limits<Index>::max();
+
+        // What a, b and c hold depends on kind:
+        //   PROGRAM, BLOCK_STATEMENT          a: statement list, b: scope or none
+        //   FUNCTION_DECLARATION              a: index into function()
+        //   VARIABLE_DECLARATION              op: DeclarationKind, a: name atom, b: initializer or none, c: location
+        //   IF_STATEMENT                      a: condition, b: body block, c: else block or none
+        //   WHILE_STATEMENT, FOR_STATEMENT    a: condition, b: body block
+        //   RETURN_STATEMENT                  a: value or none
+        //   EXPRESSION_STATEMENT              a: expression
+        //   FUNCTION_CALL                     a: name atom, b: argument list, c: location
+        //   BINARY_EXPRESSION                 op: BinaryExpression::Op, a: left, b: right
+        //   UNARY_EXPRESSION                  op: UnaryExpression::Op, a: operand
+        //   LITERAL                           a: index into literal()
+        //   VARIABLE_EXPRESSION               a: name atom, c: location
+        //   VARIABLE_ASSIGNMENT               a: name atom, b: value, c: location
+        struct Node
+        {
+            AST::Kind kind;
+            uint8_t op{0};
+            Index a{none};
+            Index b{none};
+            Index c{none};
+        };
+        static_assert(sizeof(Node) == 16);
+
+        static FlatAST build(const AST::Program& program);
+        // The function's body block, which is parsed (and resolved) first if it is lazy and hasn't been yet
+        static FlatAST build(const AST::FunctionDeclaration& function);
+
+        [[nodiscard]] const Node& node(const Index index) const { return m_nodes[index]; }
+        [[nodiscard]] std::span<const Node> nodes() const { return m_nodes; }
+        [[nodiscard]] Index root() const { return static_cast<Index>(m_nodes.size() - 1); }
+
+        [[nodiscard]] std::span<const Index> list(const Index offset) const
+        {
+            return std::span(m_lists).subspan(offset + 1, m_lists[offset]);
+        }
+
+        [[nodiscard]] const Value& literal(const Index index) const { return m_literals[index]; }
+        [[nodiscard]] const VariableLocation& location(const Index index) const { return m_locations[index]; }
+        [[nodiscard]] const ScopeInfo* scope(const Index index) const { return index == none ? nullptr : m_scopes[index]; }
+        [[nodiscard]] const AST::FunctionDeclaration& function(const Index index) const { return *m_functions[index]; }
+        [[nodiscard]] static Atom atom(const Index index) { return Atom(index); }
+
+    private:
+        FlatAST() = default;
+
+        void flatten(const AST::Node& root);
+
+        Index add_node(const Node& node);
+        Index add_list(std::span<const Index> items);
+        Index add_location(const VariableLocation& location);
+        Index add_scope(const ScopeInfo* scope);
+        Index emit(const AST::Node& node, std::span<const Index> children);
+
+        std::vector<Node> m_nodes;
+        std::vector<Index> m_lists;
+        std::vector<Value> m_literals;
+        std::vector<VariableLocation> m_locations;
+        std::vector<const ScopeInfo*> m_scopes;
+        std::vector<const AST::FunctionDeclaration*> m_functions;
+    };
+}
+
+#endif //FLAT_AST_H
@@ -0,0 +1,177 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Value.h"
+
+namespace JS
+{
+    class Heap;
+
+    // Hands the cells reachable from one to the collector. Slots are taken by reference because a minor
+    // collection moves the young cells they point to and rewrites them
+    class Tracer final
+    {
+    public:
+        void visit(Value& value)
+        {
+            if(value.is<Cell>())
+            {
+                value = Value(visit(&value.as<Cell>()));
+            }
+        }
+
+        template<typename T>
+        void visit(T*& cell)
+        {
+            if(cell)
+            {
+                cell = static_cast<T*>(visit(static_cast<Cell*>(cell)));
+            }
+        }
+
+    private:
+        friend class Heap;
+
+        enum class Mode : uint8_t
+        {
+            // Promote every young cell reached, leave old ones alone
+            EVACUATE,
+            // Mark every cell reached
+            MARK
+        };
+
+        Tracer(Heap& heap, const Mode mode) : m_heap(heap), m_mode(mode) {}
+
+        // Where the cell is once visited
+        Cell* visit(Cell* cell);
+
+        Heap& m_heap;
+        Mode m_mode;
+        // Cells reached whose edges haven't been visited yet
+        std::vector<Cell*> m_worklist;
+    };
+
+    // Owns every cell, in two generations. New cells are bumped into the nursery; a minor collection copies the
+    // ones still reachable into the old space and empties it, so its cost is what survives rather than what was
+    // allocated. The old space is collected by mark-sweep once it has grown enough.
+    //
+    // Collecting only happens when the owner asks, at points where it can name every root, so code between those
+    // points can hold cells in C++ locals without registering them anywhere. A heap is only used by the thread it
+    // is current on, so nothing here synchronizes
+    class Heap final
+    {
+    public:
+        Heap();
+        ~Heap();
+
+        // The heap Values allocate in on this thread, see CurrentHeap. Null outside of running code
+        static Heap* current() { return m_current; }
+
+        template<typename T, typename... Args>
+        T* allocate(Args&&... args)
+        {
+            constexpr auto size = (sizeof(T) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+            if(static_cast<size_t>(m_nursery_end - m_nursery_top) >= size) [[likely]]
+            {
+                auto* cell = new(std::exchange(m_nursery_top, m_nursery_top + size)) T(std::forward<Args>(args)...);
+                cell->m_size = size;
+                return cell;
+            }
+
+            // The nursery fills up between collections; until the next one, cells go straight to the old space.
+            // Their constructor may have stored young cells in them, which a barrier didn't see
+            m_collection_requested = true;
+            auto* cell = new T(std::forward<Args>(args)...);
+            adopt(cell, size);
+            remember(cell);
+            return cell;
+        }
+
+        // Must be called before storing value in a field of owner: an old cell pointing to a young one is a root of
+        // the next minor collection
+        void write_barrier(Cell& owner, const Value value)
+        {
+            if(value.is<Cell>() && is_young(&value.as<Cell>()) && !owner.m_remembered && !is_young(&owner))
+            {
+                remember(&owner);
+            }
+        }
+
+        // Whether the nursery is full or the old space has grown enough to make collecting worth it
+        [[nodiscard]] bool should_collect() const { return m_collection_requested; }
+
+        // Promotes every young cell reachable from the ones trace_roots visits, then collects the old space too if
+        // it has grown enough
+        void collect(const std::function<void(Tracer&)>& trace_roots);
+
+    private:
+        Heap(Heap&&) = delete;
+        Heap(Heap&) = delete;
+
+        friend class CurrentHeap;
+        friend class Tracer;
+
+        // Small enough that a minor collection, whose worst case is everything in it surviving, stays far below a
+        // millisecond
+        static constexpr size_t nursery_size = 256 << 10;
+        // Collecting the old space again once as much has been promoted into it as survived the last collection
+        // keeps the time spent marking proportional to what's allocated; the minimum keeps small heaps from
+        // collecting constantly
+        static constexpr size_t minimum_collection_threshold = 1 << 20;
+
+        [[nodiscard]] bool is_young(const Cell* cell) const
+        {
+            const auto* address = reinterpret_cast<const std::byte*>(cell);
+            return address >= m_nursery.get() && address < m_nursery_end;
+        }
+
+        void remember(Cell* cell)
+        {
+            cell->m_remembered = true;
+            m_remembered_set.push_back(cell);
+        }
+
+        // Links a cell made with new into the old space
+        void adopt(Cell* cell, size_t size);
+
+        void collect_nursery(const std::function<void(Tracer&)>& trace_roots);
+        void collect_old_space(const std::function<void(Tracer&)>& trace_roots);
+
+        std::unique_ptr<std::byte[]> m_nursery;
+        std::byte* m_nursery_top;
+        std::byte* m_nursery_end;
+        // Old cells that may point into the nursery
+        std::vector<Cell*> m_remembered_set;
+
+        // Every old cell, newest first
+        Cell* m_old_cells{nullptr};
+        size_t m_promoted_since_collection{0};
+        size_t m_collection_threshold{minimum_collection_threshold};
+        bool m_collection_requested{false};
+
+        static thread_local Heap* m_current;
+    };
+
+    // Makes a heap the current one on this thread for as long as it lives
+    class CurrentHeap final
+    {
+    public:
+        explicit CurrentHeap(Heap& heap) : m_previous(std::exchange(Heap::m_current, &heap)) {}
+        ~CurrentHeap() { Heap::m_current = m_previous; }
+
+    private:
+        CurrentHeap(CurrentHeap&&) = delete;
+        CurrentHeap(CurrentHeap&) = delete;
+
+        Heap* m_previous;
+    };
+}
+
+#endif //HEAP_H
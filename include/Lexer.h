@@ -2,193 +2,56 @@
 #define LEXER_H
 
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
-#include <variant>
 #include <span>
+#include <unordered_map>
 
 #include <assert.h>
 #include <cstdint>
 #include <sstream>
-#include <unordered_map>
 #include <vector>
 
+#include "Atom.h"
+#include "FileTable.h"
 #include "Log.h"
 #include "Span.h"
+#include "TokenTable.h"
 
 namespace JS
 {
-    enum class TokenType: int
-    {
-        EXCLAMATION_MARK,
-        QUESTION_MARK,
-
-        PERIOD,
-        COMMA,
-
-        LEFT_SQUARE_BRACKET,
-        RIGHT_SQUARE_BRACKET,
-
-        LEFT_CURLY_BRACE,
-        RIGHT_CURLY_BRACE,
-
-        LEFT_PAREN,
-        RIGHT_PAREN,
-
-        LESS_THAN,
-        GREATER_THAN,
-
-        LESS_THAN_EQUAL_TO,
-        GREATER_THAN_EQUAL_TO,
-
-        MINUS,
-        PLUS,
-        MULT,
-        DIV,
-        BACK_SLASH,
-        MOD,
-        XOR,
-        EQUALS,
-        OR,
-        AND,
-
-        PLUS_EQUALS,
-        MINUS_EQUALS,
-        DIV_EQUALS,
-        MULT_EQUALS,
-        MOD_EQUALS,
-        AND_EQUALS,
-        XOR_EQUALS,
-        OR_EQUALS,
-        EQUAL_EQUAL,
-        NOT_EQUAL,
-        SHIFT_LEFT,
-        SHIFT_RIGHT,
-        INCREMENT,
-        DECREMENT,
-
-        EQUAL_EQUAL_EQUAL,
-        NOT_EQUAL_EQUAL,
-
-        ARROW,
-
-        SEMICOLON,
-        COLON,
-
-        SINGLE_QUOTED_STRING,
-        DOUBLE_QUOTED_STRING,
-
-        IDENTIFIER,
-        NUMBER,
-
-        LET,
-        CONST,
-        VAR,
-        FUNCTION,
-        RETURN,
-        FOR,
-        WHILE,
-        IF,
-        CONTINUE,
-        BREAK,
-
-        NEWLINE,
-        END_OF_FILE,
-        INVALID,
-        WHITESPACE
-    };
-
-    using TokenData = std::variant<std::monostate, std::string, double>;
-
+    // 16 bytes: where the token is, plus one word of payload. Everything else (the text, the file name, line
+    // and column) is looked up in the FileTable on demand, so tokens are cheap to copy and store
     struct Token
     {
-        TokenType type;
-        TokenData data;
-        Span span;
+        // Payload is an index into TokenPayloads::cooked_strings, otherwise it is the length of the string body
+        static constexpr uint8_t COOKED_STRING = 1 << 0;
+        // Payload is the value of an integer NUMBER, otherwise it is an index into TokenPayloads::numbers
+        static constexpr uint8_t SMALL_INTEGER = 1 << 1;
 
-        // ReSharper disable once CppNonExplicitConvertingConstructor
-        Token(const TokenType _type, TokenData _data, Span _span) : type(_type), data(std::move(_data)),
-                                                                    span(std::move(_span))
+        TokenType type;
+        uint8_t flags{0};
+        FileId file_id{0};
+        uint32_t offset{0};
+        uint32_t length{0};
+        // IDENTIFIER: Atom id of the name
+        // *_QUOTED_STRING: body length, or cooked string index (see flags)
+        // NUMBER: the value itself, or an index into TokenPayloads::numbers (see flags)
+        uint32_t payload{0};
+
+        [[nodiscard]] const SourceFile& file() const { return FileTable::the().file(file_id); }
+        [[nodiscard]] std::string_view text() const { return file().slice(offset, length); }
+        [[nodiscard]] Span span() const { return {file_id, offset, offset + length}; }
+
+        [[nodiscard]] Atom atom() const
         {
+            assert(type == TokenType::IDENTIFIER);
+            return Atom{payload};
         }
 
-        Token(const TokenType _type, Span _span) : type(_type), data(std::monostate{}), span(std::move(_span))
-        {
-        } // NOLINT(*-explicit-constructor)
-
         [[nodiscard]] std::string to_string() const
         {
-            //FIXME: make a macro that enumerates token types, this sucks
-
-            const std::unordered_map<TokenType, std::string> token_names = {
-                {TokenType::EXCLAMATION_MARK, "!"},
-                {TokenType::QUESTION_MARK, "?"},
-                {TokenType::PERIOD, "."},
-                {TokenType::COMMA, ","},
-                {TokenType::LEFT_SQUARE_BRACKET, "["},
-                {TokenType::RIGHT_SQUARE_BRACKET, "]"},
-                {TokenType::LEFT_CURLY_BRACE, "{"},
-                {TokenType::RIGHT_CURLY_BRACE, "}"},
-                {TokenType::LEFT_PAREN, "("},
-                {TokenType::RIGHT_PAREN, ")"},
-                {TokenType::LESS_THAN, "<"},
-                {TokenType::GREATER_THAN, ">"},
-                {TokenType::LESS_THAN_EQUAL_TO, "<="},
-                {TokenType::GREATER_THAN_EQUAL_TO, ">="},
-                {TokenType::MINUS, "-"},
-                {TokenType::PLUS, "+"},
-                {TokenType::MULT, "*"},
-                {TokenType::DIV, "/"},
-                {TokenType::BACK_SLASH, "\\"},
-                {TokenType::MOD, "%"},
-                {TokenType::XOR, "^"},
-                {TokenType::EQUALS, "="},
-                {TokenType::OR, "|"},
-                {TokenType::AND, "&"},
-                {TokenType::PLUS_EQUALS, "+="},
-                {TokenType::MINUS_EQUALS, "-="},
-                {TokenType::DIV_EQUALS, "/="},
-                {TokenType::MULT_EQUALS, "*="},
-                {TokenType::MOD_EQUALS, "%="},
-                {TokenType::AND_EQUALS, "&="},
-                {TokenType::XOR_EQUALS, "^="},
-                {TokenType::OR_EQUALS, "|="},
-                {TokenType::EQUAL_EQUAL, "=="},
-                {TokenType::NOT_EQUAL, "!="},
-                {TokenType::SHIFT_LEFT, "<<"},
-                {TokenType::SHIFT_RIGHT, ">>"},
-                {TokenType::INCREMENT, "++"},
-                {TokenType::DECREMENT, "--"},
-                {TokenType::EQUAL_EQUAL_EQUAL, "==="},
-                {TokenType::NOT_EQUAL_EQUAL, "!=="},
-                {TokenType::ARROW, "=>"},
-                {TokenType::SEMICOLON, ";"},
-                {TokenType::COLON, ":"},
-                {TokenType::SINGLE_QUOTED_STRING, "Single quoted string"},
-                {TokenType::DOUBLE_QUOTED_STRING, "Double quoted string"},
-                {TokenType::IDENTIFIER, "Identifier"},
-                {TokenType::NUMBER, "Number"},
-                {TokenType::LET, "let"},
-                {TokenType::VAR, "var"},
-                {TokenType::CONST, "const"},
-                {TokenType::FUNCTION, "function"},
-                {TokenType::RETURN, "return"},
-                {TokenType::FOR, "for"},
-                {TokenType::IF, "if"},
-                {TokenType::WHILE, "while"},
-                {TokenType::CONTINUE, "continue"},
-                {TokenType::BREAK, "break"},
-                {TokenType::NEWLINE, "\\n"},
-                {TokenType::END_OF_FILE, "EOF"},
-                {TokenType::INVALID, "Invalid"},
-                {TokenType::WHITESPACE, "\\w"}
-            };
-
-            if (!token_names.contains(type))
-            {
-                Log::the().critical("No name for TokenType ", static_cast<int>(type));
-                return "";
-            }
-
             std::ostringstream data_string;
             data_string << "(";
             bool has_extra_data = true;
@@ -197,7 +60,7 @@ namespace JS
             case TokenType::IDENTIFIER:
             case TokenType::SINGLE_QUOTED_STRING:
             case TokenType::DOUBLE_QUOTED_STRING:
-                data_string << unwrap<std::string>();
+                data_string << unwrap<std::string_view>();
                 break;
             case TokenType::NUMBER:
                 data_string << unwrap<double>();
@@ -206,10 +69,10 @@ namespace JS
                 has_extra_data = false;
                 break;
             }
-            data_string << ") at " << span.to_string();
+            data_string << ") at " << span().to_string();
 
             std::ostringstream output;
-            output << token_names.at(type);
+            output << TokenTable::name(type);
             if (has_extra_data)
             {
                 output << data_string.str();
@@ -220,46 +83,105 @@ namespace JS
         template <typename T>
         [[nodiscard]] T unwrap() const
         {
-            assert(std::holds_alternative<T>(data));
-            return std::get<T>(data);
+            if constexpr (std::is_same_v<T, double>)
+            {
+                assert(type == TokenType::NUMBER);
+                if (flags & SMALL_INTEGER)
+                {
+                    return payload;
+                }
+                return file().payloads.numbers[payload];
+            }
+            else
+            {
+                static_assert(std::is_same_v<T, std::string_view>);
+                if (type == TokenType::IDENTIFIER)
+                {
+                    return text();
+                }
+
+                assert(type == TokenType::SINGLE_QUOTED_STRING || type == TokenType::DOUBLE_QUOTED_STRING);
+                if (flags & COOKED_STRING)
+                {
+                    return file().payloads.cooked_strings[payload];
+                }
+                return file().slice(offset + 1, payload);
+            }
         }
     };
 
+    static_assert(sizeof(Token) == 16);
+
+    struct LexerOptions
+    {
+        // lex() splits inputs at least this large into chunks of roughly chunk_size and lexes them on the thread pool
+        size_t parallel_threshold{8 * 1024 * 1024};
+        size_t chunk_size{1024 * 1024};
+    };
+
     class Lexer
     {
     public:
-        explicit Lexer(std::span<const char>);
-        std::vector<Token> lex(const std::string& file_name);
+        explicit Lexer(FileId file_id, LexerOptions options = {});
+        // Lexes only [start, end) of the file, reporting END_OF_FILE at end
+        Lexer(FileId file_id, size_t start, size_t end);
+        std::vector<Token> lex();
         Token next();
 
+        [[nodiscard]] bool lexes_in_parallel() const;
+        // Whether lexing so far logged any errors. Cached tokens skip the lexer, so such files mustn't be cached
+        [[nodiscard]] bool reported_errors() const { return m_reported_errors; }
+
+        // The tokens of a file after edit, given its tokens from before. Only the damaged region is lexed again, the
+        // tokens on either side of it are reused (and shifted, after it). The file must already hold the new contents
+        static std::vector<Token> relex(FileId file_id, std::span<const Token> previous, const TextEdit& edit);
+
     private:
-        template <typename P>
-        std::span<const char> consume_while(P predicate);
+        // The identifiers a speculative lexer met. Its IDENTIFIER payloads index names rather than the AtomTable
+        // until the chunk is accepted, so a chunk that is thrown away never interns its garbage
+        struct SpeculativeNames
+        {
+            std::unordered_map<std::string_view, uint32_t> ids;
+            std::vector<std::string_view> names;
+        };
+
+        // Speculative lexer for one chunk of a parallel lex: starts at an arbitrary offset, can't see past limit,
+        // writes payloads and names to private tables and throws InvalidSyntax instead of reporting errors
+        Lexer(FileId file_id, size_t start, size_t limit, TokenPayloads& payloads, SpeculativeNames& names);
 
-        std::span<const char> consume_until(char c);
+        std::vector<Token> lex_parallel();
+        void lex_until(size_t stop, std::vector<Token>& tokens);
+        void report_error(const char* message) const;
+
+        void skip_trivia();
+
+        Token lex_number();
+        size_t consume_digits(unsigned radix, bool& has_separators);
+        [[noreturn]] void number_error(const char* message) const;
+
+        Token lex_string();
+        void consume_closing_quote(char quote);
+        void append_escape_sequence(std::string& cooked);
 
         std::span<const char> consume(size_t n);
         char consume();
 
-        [[nodiscard]] Span span_from_here(size_t num_characters_back = 1) const;
-
-        void rewind(size_t off = 1);
+        [[nodiscard]] Token make_token(TokenType type, size_t start, uint32_t payload = 0, uint8_t flags = 0) const;
 
         [[nodiscard]] char peek(size_t off = 0) const;
 
-        [[nodiscard]] bool matches(const std::string& pattern) const;
+        [[nodiscard]] bool matches(std::string_view pattern) const;
 
-        std::unordered_map<std::string, TokenType> m_keywords;
-        std::unordered_map<std::string, TokenType> m_three_character_symbols;
-        std::unordered_map<std::string, TokenType> m_two_character_symbols;
-        std::unordered_map<std::string, TokenType> m_one_character_symbols;
+        SourceFile& m_file;
+        FileId m_file_id;
+        TokenPayloads& m_payloads;
+        LexerOptions m_options;
+        bool m_speculative{false};
+        SpeculativeNames* m_speculative_names{nullptr};
+        mutable bool m_reported_errors{false};
 
         std::span<const char> m_input;
         size_t m_index;
-
-        size_t m_col{0};
-        size_t m_line_number{0};
-        std::string m_filename{};
     };
 }
 
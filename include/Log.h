@@ -19,12 +19,8 @@ public:
 
     static Log& the()
     {
-        if (!m_the)
-        {
-            m_the = new Log;
-        }
-
-        return *m_the;
+        static Log log;
+        return log;
     }
 
     //TODO: format output with colors, add timestamp, custom log format
@@ -79,6 +75,8 @@ public:
         m_log_level = level;
     }
 
+    [[nodiscard]] Level level() const { return m_log_level; }
+
 private:
 
     static void log_inner() {}
@@ -96,8 +94,6 @@ private:
     Log(Log&) = delete;
 
     Level m_log_level {Level::INFO};
-
-    static Log* m_the;
 };
 
 
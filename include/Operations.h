@@ -0,0 +1,35 @@
+#ifndef OPERATIONS_H
+#define OPERATIONS_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "AST.h"
+#include "Value.h"
+
+namespace JS::Operations
+{
+    // The spec's abstract operations on primitive values. Shared by constant folding and the runtime so the two
+    // can't disagree about what an expression evaluates to
+
+    [[nodiscard]] double to_number(const Value& value);
+    // StringToNumber: surrounding whitespace ignored, "" is 0, decimal/0x/0o/0b/Infinity, anything else NaN
+    [[nodiscard]] double string_to_number(std::string_view string);
+    [[nodiscard]] std::string to_string(const Value& value);
+    // Number::toString(10), shortest round-trip digits
+    [[nodiscard]] std::string number_to_string(double number);
+    [[nodiscard]] bool to_boolean(const Value& value);
+    [[nodiscard]] int32_t to_int32(double number);
+    [[nodiscard]] uint32_t to_uint32(double number);
+
+    [[nodiscard]] bool is_loosely_equal(const Value& left, const Value& right);
+    [[nodiscard]] bool is_strictly_equal(const Value& left, const Value& right);
+
+    // Results of operators on primitive operands, empty if an operand isn't a primitive
+    [[nodiscard]] std::optional<Value> binary_operation(AST::BinaryExpression::Op op, const Value& left, const Value& right);
+    [[nodiscard]] std::optional<Value> unary_operation(AST::UnaryExpression::Op op, const Value& operand);
+}
+
+#endif //OPERATIONS_H
@@ -1,21 +1,107 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <concepts>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
 #include "AST.h"
 #include "Lexer.h"
+#include "TokenStream.h"
 
 namespace JS {
 
+    struct ParserOptions
+    {
+        enum class FunctionBodies
+        {
+            // Parsed in line with everything else
+            EAGER,
+            // Only checked for balanced brackets, and parsed the first time they are needed, see
+            // AST::FunctionDeclaration::body()
+            LAZY,
+            // Checked like LAZY, then the bodies of the functions parse() met are parsed on the thread pool before it
+            // returns. Functions nested in those are still LAZY
+            PARALLEL
+        };
+
+        FunctionBodies function_bodies{FunctionBodies::LAZY};
+        // Smallest number of body tokens worth a pool task of their own; smaller bodies are batched together
+        size_t parallel_batch_tokens{16 * 1024};
+        // Operators on literals are replaced by their result, and if/while statements whose condition is a literal
+        // lose the branch that can never run
+        bool fold_constants{true};
+    };
+
     class Parser {
     public:
 
-        explicit Parser(const std::vector<Token>& tokens) : m_tokens(tokens) {}
+        explicit Parser(TokenStream& tokens, const ParserOptions options = {}) : m_tokens(tokens), m_options(options) {}
 
         AST parse();
 
+        // Parses the braced block at body into arena, for a lazily parsed function declaration. options are the
+        // ones its declaration was pre-parsed with, see m_lazy_options
+        static AST::BlockStatement* parse_lazy_body(Arena& arena, const Span& body, const ParserOptions& options);
+
+        // Parses an edited file (the stream should come from Lexer::relex), taking every lazily parsed function
+        // declaration in previous that the edit left untouched as it is instead of pre-parsing it again. previous is
+        // only read, the new tree shares no nodes with it
+        AST reparse(const AST& previous, const TextEdit& edit);
+
     private:
-        std::vector<Token> m_tokens;
-        size_t m_index{0};
+        TokenStream& m_tokens;
+        ParserOptions m_options;
+        // m_options for the bodies skipped now and parsed on first use, kept in the tree's arena so the declarations
+        // can point to them
+        const ParserOptions* m_lazy_options{nullptr};
+
+        // Untouched declarations from the previous parse, keyed by where they start in the edited file
+        std::unordered_map<uint32_t, const AST::FunctionDeclaration*> m_reusable_functions;
+        int64_t m_edit_delta{0};
+
+        // Nodes of the tree being built; handed over to the AST when parsing finishes
+        std::shared_ptr<Arena> m_arena;
+
+        // Child lists are collected here and copied into the arena once complete, so building one allocates
+        // nothing after warm-up. Nested lists stack on top of their parent's entries and pop them when done
+        std::vector<AST::Statement*> m_statement_scratch;
+        std::vector<AST::Expression*> m_expression_scratch;
+        std::vector<AST::Parameter*> m_parameter_scratch;
+        std::vector<TokenType> m_bracket_scratch;
+        std::vector<Atom> m_identifier_scratch;
+
+        // Skipped bodies for FunctionBodies::PARALLEL, with their tokens from { to } so workers don't lex again
+        struct DeferredBody
+        {
+            AST::FunctionDeclaration* function;
+            std::vector<Token> tokens;
+        };
+        std::vector<DeferredBody> m_deferred_bodies;
+        void parse_deferred_bodies();
+
+        // Operator chains are parsed in a loop, only parentheses and prefix operators nest; this bounds how deep
+        static constexpr size_t max_expression_depth = 1024;
+        size_t m_expression_depth{0};
+
+        void collect_reusable_functions(const AST::Node* node, const TextEdit& edit);
+        [[nodiscard]] AST::FunctionDeclaration* reuse_function_declaration();
+
+        template <typename T, typename... Args>
+        T* make(Args&&... args)
+        {
+            return m_arena->make<T>(std::forward<Args>(args)...);
+        }
+
+        template <typename T>
+        std::span<T* const> take_scratch(std::vector<T*>& scratch, const size_t base)
+        {
+            const auto list = m_arena->copy(std::span<T* const>(scratch).subspan(base));
+            scratch.resize(base);
+            return list;
+        }
 
         void consume_semicolon_if_exists()
         {
@@ -27,12 +113,12 @@ namespace JS {
 
         Token consume()
         {
-            return m_tokens[m_index++];
+            return m_tokens.consume();
         }
 
         Token consume(const TokenType expected_type)
         {
-            const auto token = m_tokens[m_index++];
+            const auto token = m_tokens.consume();
             if(token.type != expected_type)
             {
                 throw std::runtime_error("Consumed invalid token type");
@@ -41,45 +127,55 @@ namespace JS {
             return token;
         }
 
-        [[nodiscard]] Token peek() const
+        // References into the stream's lookahead window; they stay valid until the token is consumed
+        [[nodiscard]] const Token& peek()
         {
-            return m_tokens[m_index];
+            return m_tokens.peek();
         }
 
-        [[nodiscard]] Token peek(const size_t off) const
+        [[nodiscard]] const Token& peek(const size_t off)
         {
-            return m_tokens[m_index + off];
+            return m_tokens.peek(off);
         }
 
-        [[nodiscard]] bool match(const std::vector<TokenType>& types) const
+        // True if the next tokens are exactly types, in order
+        template <std::same_as<TokenType>... Types>
+        [[nodiscard]] bool match(const Types... types)
         {
+            static_assert(sizeof...(Types) > 0 && sizeof...(Types) <= TokenStream::max_lookahead);
             size_t i = 0;
-            for(const auto& type : types)
-            {
-                if(peek(i).type != type)
-                {
-                    return false;
-                }
-                ++i;
-            }
+            return ((peek(i++).type == types) && ...);
+        }
 
-            return true;
+        // True if the next token is any of types
+        [[nodiscard]] bool match_any(const TokenSet& types)
+        {
+            return types.contains(peek().type);
         }
 
-        [[nodiscard]] std::vector<std::shared_ptr<AST::Statement>> parse_block(const std::vector<TokenType>& stoppers);
-        [[nodiscard]] std::vector<std::shared_ptr<AST::Parameter>> parse_parameters();
-        [[nodiscard]] std::shared_ptr<AST::Expression> parse_expression();
-        [[nodiscard]] std::shared_ptr<AST::FunctionCall> parse_function_call();
-        [[nodiscard]] std::shared_ptr<AST::BinaryExpression> parse_binary_expression();
-        [[nodiscard]] std::shared_ptr<AST::Literal> parse_literal();
-        [[nodiscard]] std::shared_ptr<AST::VariableAssignment> parse_variable_assignment();
-        [[nodiscard]] std::shared_ptr<AST::FunctionDeclaration> parse_function_declaration();
-        [[nodiscard]] std::shared_ptr<AST::VariableDeclaration> parse_variable_declaration();
-        [[nodiscard]] std::shared_ptr<AST::FunctionCallStatement> parse_function_call_statement();
-        [[nodiscard]] std::shared_ptr<AST::IfStatement> parse_if_statement();
-        [[nodiscard]] std::shared_ptr<AST::WhileStatement> parse_while_statement();
-        [[nodiscard]] std::shared_ptr<AST::ForStatement> parse_for_statement();
-        [[nodiscard]] std::shared_ptr<AST::ReturnStatement> parse_return_statement();
+        [[nodiscard]] std::span<AST::Statement* const> parse_block(const TokenSet& stoppers);
+        // Null when the statement was folded away
+        [[nodiscard]] AST::Statement* parse_statement();
+        // A braced block, or a single statement wrapped in one (the body of an if or a loop)
+        [[nodiscard]] AST::BlockStatement* parse_body();
+        // Consumes a braced function body without building it, returns its closing brace. The identifiers in it
+        // are left in m_identifier_scratch, and its tokens are appended to tokens if that isn't null
+        Token skip_function_body(std::vector<Token>* tokens = nullptr);
+        [[nodiscard]] std::span<AST::Parameter* const> parse_parameters();
+        [[nodiscard]] AST::Expression* parse_expression(uint8_t min_binding_power = 0);
+        [[nodiscard]] AST::Expression* parse_prefix_expression();
+        // The operator applied to its operands, or its result if they are literals and folding is enabled
+        [[nodiscard]] AST::Expression* make_binary(AST::Expression* left, AST::Expression* right, AST::BinaryExpression::Op op);
+        [[nodiscard]] AST::Expression* make_unary(AST::Expression* operand, AST::UnaryExpression::Op op);
+        [[nodiscard]] AST::FunctionCall* parse_function_call();
+        [[nodiscard]] AST::Literal* parse_literal();
+        [[nodiscard]] AST::ExpressionStatement* parse_expression_statement();
+        [[nodiscard]] AST::FunctionDeclaration* parse_function_declaration();
+        [[nodiscard]] AST::VariableDeclaration* parse_variable_declaration();
+        [[nodiscard]] AST::Statement* parse_if_statement();
+        [[nodiscard]] AST::Statement* parse_while_statement();
+        [[nodiscard]] AST::ForStatement* parse_for_statement();
+        [[nodiscard]] AST::ReturnStatement* parse_return_statement();
     };
 }
 
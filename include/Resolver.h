@@ -0,0 +1,51 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <span>
+#include <vector>
+
+#include "Arena.h"
+#include "AST.h"
+#include "Scope.h"
+
+namespace JS
+{
+    // Post-parse pass that gives every var/let/const/function binding a slot in a ScopeInfo and annotates each
+    // reference with the (hops, slot) it will find its variable at, so the runtime never looks a local up by name.
+    // Function bodies that haven't been parsed yet are not parsed for this: every name in them counts as a
+    // capture of the outer binding it could refer to, and the body itself is resolved when it is parsed
+    class Resolver
+    {
+    public:
+        // Scopes are allocated in arena, which must outlive the tree being resolved
+        explicit Resolver(Arena& arena) : m_arena(arena) {}
+
+        static void resolve(const AST& ast);
+
+        void resolve_program(AST::Program& program);
+        // A lazily parsed body that was just parsed, in the scope its declaration was resolved in
+        void resolve_function(const AST::FunctionDeclaration& function);
+
+    private:
+        // Declares what the statements hoist into their scopes: vars (from nested blocks too) into var_scope,
+        // let, const and function declarations into lexical_scope
+        void declare_hoisted(std::span<AST::Statement* const> statements, ScopeInfo& var_scope, ScopeInfo& lexical_scope);
+        void declare_vars(const AST::BlockStatement& block, ScopeInfo& var_scope);
+
+        void resolve_statements(std::span<AST::Statement* const> statements, ScopeInfo& scope);
+        void resolve_block(const AST::BlockStatement& block, ScopeInfo& scope);
+        void resolve_function_declaration(const AST::FunctionDeclaration& function, ScopeInfo& scope);
+        void resolve_function_body(const AST::FunctionDeclaration& function);
+        void resolve_expression(const AST::Expression* expression, ScopeInfo& scope);
+
+        // from_nested_function: the reference is inside a function declared in scope, so whatever it finds is
+        // captured
+        static VariableLocation lookup(Atom name, ScopeInfo& scope, bool from_nested_function = false);
+
+        Arena& m_arena;
+        // Expressions are walked with an explicit stack, operator chains can be deeper than the native one
+        std::vector<const AST::Expression*> m_expression_stack;
+    };
+}
+
+#endif //RESOLVER_H
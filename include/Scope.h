@@ -1,10 +1,127 @@
-
 #ifndef SCOPE_H
 #define SCOPE_H
 
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "Atom.h"
+#include "Heap.h"
+#include "Value.h"
+
 namespace JS
 {
-    class Scope {};
+    // A scope at runtime, holding the bindings of one ScopeInfo that closures captured. Only scopes with captured
+    // bindings get one; everything else lives in the registers of the frame that declares it
+    class Scope final : public Cell
+    {
+    public:
+        static constexpr auto cell_kind = Kind::SCOPE;
+
+        Scope(Scope* parent, const uint32_t slot_count) : Cell(cell_kind), m_parent(parent), m_slots(slot_count) {}
+
+        [[nodiscard]] Scope* parent() const { return m_parent; }
+        [[nodiscard]] const Value& slot(const uint32_t slot) const { return m_slots[slot]; }
+        void set_slot(Heap& heap, const uint32_t slot, const Value value)
+        {
+            heap.write_barrier(*this, value);
+            m_slots[slot] = value;
+        }
+
+        void visit_edges(Tracer& tracer) override
+        {
+            tracer.visit(m_parent);
+            for(auto& slot : m_slots)
+            {
+                tracer.visit(slot);
+            }
+        }
+        Cell* promote() override { return new Scope(std::move(*this)); }
+
+    private:
+        Scope* m_parent;
+        std::vector<Value> m_slots;
+    };
+
+    // Where a variable lives at runtime: hops scopes up the chain from the one the reference is in, then slot in
+    // that scope. References the resolver found no declaration for are looked up by name in the global object
+    struct VariableLocation
+    {
+        static constexpr uint32_t unresolved = std::numeric_limits<uint32_t>::max();
+
+        uint32_t hops{unresolved};
+        uint32_t slot{0};
+
+        [[nodiscard]] bool is_resolved() const { return hops != unresolved; }
+    };
+
+    // The bindings of one runtime scope, built by the Resolver: a function's parameters, vars and nested function
+    // declarations, or the let/const/function declarations of a block. Slots are numbered in declaration order,
+    // parameters first
+    class ScopeInfo
+    {
+    public:
+        enum class Kind : uint8_t
+        {
+            GLOBAL,
+            FUNCTION,
+            BLOCK
+        };
+
+        struct Binding
+        {
+            Atom name;
+            // Referenced from a function nested inside the one that declares it, so it has to outlive its frame
+            bool captured{false};
+        };
+
+        ScopeInfo(const Kind kind, ScopeInfo* parent) : m_kind(kind), m_parent(parent) {}
+
+        // The slot for name, reusing the existing one if it is declared twice (var x; var x;)
+        uint32_t declare(const Atom name)
+        {
+            const auto [slot, inserted] = m_slots.try_emplace(name, static_cast<uint32_t>(m_bindings.size()));
+            if(inserted)
+            {
+                m_bindings.push_back({name});
+            }
+
+            return slot->second;
+        }
+
+        [[nodiscard]] std::optional<uint32_t> find(const Atom name) const
+        {
+            const auto slot = m_slots.find(name);
+            if(slot == m_slots.end())
+            {
+                return std::nullopt;
+            }
+
+            return slot->second;
+        }
+
+        void mark_captured(const uint32_t slot)
+        {
+            m_captured_count += !m_bindings[slot].captured;
+            m_bindings[slot].captured = true;
+        }
+
+        [[nodiscard]] Kind kind() const { return m_kind; }
+        [[nodiscard]] ScopeInfo* parent() const { return m_parent; }
+        [[nodiscard]] uint32_t slot_count() const { return static_cast<uint32_t>(m_bindings.size()); }
+        [[nodiscard]] const Binding& binding(const uint32_t slot) const { return m_bindings[slot]; }
+        // Whether this scope needs a Scope at runtime
+        [[nodiscard]] bool has_captured_bindings() const { return m_captured_count > 0; }
+
+    private:
+        Kind m_kind;
+        ScopeInfo* m_parent;
+        std::vector<Binding> m_bindings;
+        std::unordered_map<Atom, uint32_t> m_slots;
+        uint32_t m_captured_count{0};
+    };
 }
 
 #endif //SCOPE_H
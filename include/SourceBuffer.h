@@ -0,0 +1,42 @@
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+#include <span>
+#include <string>
+#include <vector>
+
+namespace JS
+{
+    // The bytes of a source file. Regular files are memory-mapped so the lexer reads the page cache directly;
+    // pipes, stdin ("-") and anything else that can't be mapped are read into an owned buffer instead.
+    // Move-only: token views point into bytes(), so the buffer must outlive them (see FileTable::add)
+    class SourceBuffer
+    {
+    public:
+        static SourceBuffer load(const std::string& path);
+
+        SourceBuffer(SourceBuffer&& other) noexcept;
+        SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+        SourceBuffer(const SourceBuffer&) = delete;
+        SourceBuffer& operator=(const SourceBuffer&) = delete;
+        ~SourceBuffer();
+
+        [[nodiscard]] std::span<const char> bytes() const
+        {
+            return m_mapping ? std::span<const char>{m_mapping, m_size} : std::span<const char>{m_buffer};
+        }
+
+        [[nodiscard]] bool is_mapped() const { return m_mapping != nullptr; }
+
+    private:
+        SourceBuffer() = default;
+
+        void release();
+
+        const char* m_mapping{nullptr};
+        size_t m_size{0};
+        std::vector<char> m_buffer;
+    };
+}
+
+#endif //SOURCE_BUFFER_H
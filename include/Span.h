@@ -1,25 +1,27 @@
-
 #ifndef SPAN_H
 #define SPAN_H
+#include <cstdint>
+#include <sstream>
 #include <string>
 
+#include "FileTable.h"
+
 namespace JS {
-    struct FilePosition
-    {
-        size_t line;
-        size_t column;
-        size_t character_index;
-    };
     struct Span
     {
-        const std::string file_name;
-        const FilePosition start;
-        const FilePosition end;
+        FileId file_id;
+        uint32_t start;
+        uint32_t end;
+
+        [[nodiscard]] FilePosition start_position() const { return FileTable::the().file(file_id).position_of(start); }
+        [[nodiscard]] FilePosition end_position() const { return FileTable::the().file(file_id).position_of(end); }
 
         [[nodiscard]] std::string to_string() const
         {
+            const auto start_pos = start_position();
+            const auto end_pos = end_position();
             std::ostringstream buf;
-            buf << "Span [file=" << file_name << "] at [" << start.line << ":" << start.column << " to " << end.line << ":" << end.column << "]";
+            buf << "Span [file=" << FileTable::the().file(file_id).name << "] at [" << start_pos.line << ":" << start_pos.column << " to " << end_pos.line << ":" << end_pos.column << "]";
             return buf.str();
         }
     };
@@ -0,0 +1,61 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace JS
+{
+    // One FIFO queue behind one mutex. The jobs it gets are coarse (a megabyte chunk of lexing, a batch of function
+    // bodies worth thousands of tokens), all submitted up front by one thread, and none of them spawn more, so
+    // there's no imbalance for per-worker deques and stealing to fix and the lock is taken once per job
+    class ThreadPool final
+    {
+    public:
+        // Shared pool with one worker per hardware thread, created on first use
+        static ThreadPool& the()
+        {
+            // Function-local statics are initialized exactly once even if several threads get here first
+            static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+            return pool;
+        }
+
+        explicit ThreadPool(size_t thread_count);
+        ~ThreadPool();
+
+        [[nodiscard]] size_t thread_count() const { return m_workers.size(); }
+
+        template <typename F>
+        auto submit(F&& task) -> std::future<std::invoke_result_t<F>>
+        {
+            using Result = std::invoke_result_t<F>;
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+            auto future = packaged->get_future();
+            enqueue([packaged] { (*packaged)(); });
+            return future;
+        }
+
+    private:
+        ThreadPool(ThreadPool&&) = delete;
+        ThreadPool(ThreadPool&) = delete;
+
+        void enqueue(std::function<void()> job);
+        void worker_loop();
+
+        std::vector<std::thread> m_workers;
+        std::queue<std::function<void()>> m_jobs;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        bool m_stopping{false};
+    };
+}
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,63 @@
+#ifndef TOKEN_CACHE_H
+#define TOKEN_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+#include "Lexer.h"
+
+namespace JS
+{
+    // Bump whenever the lexer could produce different tokens for the same input, or the entry layout changes
+    constexpr uint32_t token_cache_version = 3;
+
+    // Tokens loaded from a cache entry. The token array is used in place from a private (copy-on-write) mapping of
+    // the entry, so it is only valid while this object is alive
+    class CachedTokens
+    {
+    public:
+        CachedTokens(CachedTokens&& other) noexcept;
+        CachedTokens& operator=(CachedTokens&& other) noexcept;
+        CachedTokens(const CachedTokens&) = delete;
+        CachedTokens& operator=(const CachedTokens&) = delete;
+        ~CachedTokens();
+
+        [[nodiscard]] std::span<const Token> tokens() const { return m_tokens; }
+
+    private:
+        friend class TokenCache;
+        CachedTokens(void* mapping, size_t size, std::span<const Token> tokens);
+
+        void* m_mapping{nullptr};
+        size_t m_size{0};
+        std::span<const Token> m_tokens;
+    };
+
+    // On-disk cache of lexed token streams, keyed by a hash of the source bytes and token_cache_version.
+    // Entries are self-contained: identifiers, numbers and decoded strings are stored with the tokens and rebound
+    // to the current process's AtomTable and FileTable on load
+    class TokenCache
+    {
+    public:
+        explicit TokenCache(std::filesystem::path directory) : m_directory(std::move(directory)) {}
+
+        // $JS_CACHE_DIR, nothing if it isn't set. Entries are never evicted, so caching is opt-in
+        static std::optional<std::filesystem::path> default_directory();
+
+        [[nodiscard]] std::optional<CachedTokens> load(FileId file_id) const;
+
+        // Best effort, a cache that can't be written is just a cache miss next time
+        void store(FileId file_id, std::span<const Token> tokens) const;
+
+        static uint64_t hash(std::span<const char> bytes);
+
+    private:
+        [[nodiscard]] std::filesystem::path entry_path(uint64_t source_hash) const;
+
+        std::filesystem::path m_directory;
+    };
+}
+
+#endif //TOKEN_CACHE_H
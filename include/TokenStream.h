@@ -0,0 +1,71 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <span>
+
+#include "Lexer.h"
+
+namespace JS
+{
+    // Pulls tokens out of a Lexer on demand and keeps only the lookahead window in a ring buffer, so parsing
+    // never holds more than max_lookahead tokens in memory regardless of the size of the file.
+    // Can also walk tokens that were already lexed (in parallel, for example); they must end with END_OF_FILE
+    class TokenStream
+    {
+    public:
+        static constexpr size_t max_lookahead = 16;
+        static_assert((max_lookahead & (max_lookahead - 1)) == 0, "Ring size must be a power of two");
+
+        explicit TokenStream(Lexer& lexer) : m_lexer(&lexer) {}
+        explicit TokenStream(const std::span<const Token> tokens) : m_tokens(tokens)
+        {
+            assert(!tokens.empty() && tokens.back().type == TokenType::END_OF_FILE);
+        }
+
+        [[nodiscard]] const Token& peek(const size_t off = 0)
+        {
+            assert(off < max_lookahead);
+            if (!m_lexer)
+            {
+                return m_tokens[std::min(m_position + off, m_tokens.size() - 1)];
+            }
+
+            while (m_count <= off)
+            {
+                fill();
+            }
+            return m_ring[(m_head + off) & (max_lookahead - 1)];
+        }
+
+        Token consume()
+        {
+            if (!m_lexer)
+            {
+                const Token token = peek();
+                m_position = std::min(m_position + 1, m_tokens.size() - 1);
+                return token;
+            }
+
+            const Token token = peek();
+            m_head = (m_head + 1) & (max_lookahead - 1);
+            --m_count;
+            return token;
+        }
+
+    private:
+        void fill();
+
+        Lexer* m_lexer{nullptr};
+        std::array<Token, max_lookahead> m_ring{};
+        size_t m_head{0};
+        size_t m_count{0};
+
+        std::span<const Token> m_tokens;
+        size_t m_position{0};
+    };
+}
+
+#endif //TOKEN_STREAM_H
@@ -0,0 +1,330 @@
+#ifndef TOKEN_TABLE_H
+#define TOKEN_TABLE_H
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <string_view>
+
+namespace JS
+{
+    // The one place token types are declared. Every other table (names, punctuator dispatch, keyword hash)
+    // is derived from this list at compile time, so adding a token here is all that's needed.
+    // PUNCTUATOR(name, text): lexed by the first-byte jump table, longest match wins
+    // KEYWORD(name, text): lexed as an identifier, then looked up in the keyword perfect hash
+    // TOKEN(name, description): everything else, produced by hand in the lexer
+#define ENUMERATE_TOKENS(PUNCTUATOR, KEYWORD, TOKEN) \
+    PUNCTUATOR(EXCLAMATION_MARK, "!") \
+    PUNCTUATOR(QUESTION_MARK, "?") \
+    \
+    PUNCTUATOR(PERIOD, ".") \
+    PUNCTUATOR(COMMA, ",") \
+    \
+    PUNCTUATOR(LEFT_SQUARE_BRACKET, "[") \
+    PUNCTUATOR(RIGHT_SQUARE_BRACKET, "]") \
+    \
+    PUNCTUATOR(LEFT_CURLY_BRACE, "{") \
+    PUNCTUATOR(RIGHT_CURLY_BRACE, "}") \
+    \
+    PUNCTUATOR(LEFT_PAREN, "(") \
+    PUNCTUATOR(RIGHT_PAREN, ")") \
+    \
+    PUNCTUATOR(LESS_THAN, "<") \
+    PUNCTUATOR(GREATER_THAN, ">") \
+    \
+    PUNCTUATOR(LESS_THAN_EQUAL_TO, "<=") \
+    PUNCTUATOR(GREATER_THAN_EQUAL_TO, ">=") \
+    \
+    PUNCTUATOR(MINUS, "-") \
+    PUNCTUATOR(PLUS, "+") \
+    PUNCTUATOR(MULT, "*") \
+    PUNCTUATOR(DIV, "/") \
+    PUNCTUATOR(BACK_SLASH, "\\") \
+    PUNCTUATOR(MOD, "%") \
+    PUNCTUATOR(XOR, "^") \
+    PUNCTUATOR(EQUALS, "=") \
+    PUNCTUATOR(OR, "|") \
+    PUNCTUATOR(AND, "&") \
+    \
+    PUNCTUATOR(PLUS_EQUALS, "+=") \
+    PUNCTUATOR(MINUS_EQUALS, "-=") \
+    PUNCTUATOR(DIV_EQUALS, "/=") \
+    PUNCTUATOR(MULT_EQUALS, "*=") \
+    PUNCTUATOR(MOD_EQUALS, "%=") \
+    PUNCTUATOR(AND_EQUALS, "&=") \
+    PUNCTUATOR(XOR_EQUALS, "^=") \
+    PUNCTUATOR(OR_EQUALS, "|=") \
+    PUNCTUATOR(EQUAL_EQUAL, "==") \
+    PUNCTUATOR(NOT_EQUAL, "!=") \
+    PUNCTUATOR(SHIFT_LEFT, "<<") \
+    PUNCTUATOR(SHIFT_RIGHT, ">>") \
+    PUNCTUATOR(INCREMENT, "++") \
+    PUNCTUATOR(DECREMENT, "--") \
+    \
+    PUNCTUATOR(EQUAL_EQUAL_EQUAL, "===") \
+    PUNCTUATOR(NOT_EQUAL_EQUAL, "!==") \
+    \
+    PUNCTUATOR(ARROW, "=>") \
+    \
+    PUNCTUATOR(SEMICOLON, ";") \
+    PUNCTUATOR(COLON, ":") \
+    \
+    TOKEN(SINGLE_QUOTED_STRING, "Single quoted string") \
+    TOKEN(DOUBLE_QUOTED_STRING, "Double quoted string") \
+    \
+    TOKEN(IDENTIFIER, "Identifier") \
+    TOKEN(NUMBER, "Number") \
+    \
+    KEYWORD(LET, "let") \
+    KEYWORD(CONST, "const") \
+    KEYWORD(VAR, "var") \
+    KEYWORD(FUNCTION, "function") \
+    KEYWORD(RETURN, "return") \
+    KEYWORD(FOR, "for") \
+    KEYWORD(WHILE, "while") \
+    KEYWORD(IF, "if") \
+    KEYWORD(ELSE, "else") \
+    KEYWORD(CONTINUE, "continue") \
+    KEYWORD(BREAK, "break") \
+    KEYWORD(TRUE_LITERAL, "true") \
+    KEYWORD(FALSE_LITERAL, "false") \
+    KEYWORD(NULL_LITERAL, "null") \
+    \
+    TOKEN(NEWLINE, "\\n") \
+    TOKEN(END_OF_FILE, "EOF") \
+    TOKEN(INVALID, "Invalid")
+
+    enum class TokenType: uint8_t
+    {
+#define ENUMERATE_TOKEN_TYPE(name, text) name,
+        ENUMERATE_TOKENS(ENUMERATE_TOKEN_TYPE, ENUMERATE_TOKEN_TYPE, ENUMERATE_TOKEN_TYPE)
+#undef ENUMERATE_TOKEN_TYPE
+    };
+
+    struct TokenDescriptor
+    {
+        TokenType type;
+        std::string_view text;
+    };
+
+    namespace TokenTable
+    {
+#define ENUMERATE_TOKEN_DESCRIPTOR(name, text) TokenDescriptor{TokenType::name, text},
+#define ENUMERATE_NOTHING(name, text)
+
+        constexpr TokenDescriptor all[] = {
+            ENUMERATE_TOKENS(ENUMERATE_TOKEN_DESCRIPTOR, ENUMERATE_TOKEN_DESCRIPTOR, ENUMERATE_TOKEN_DESCRIPTOR)
+        };
+
+        constexpr TokenDescriptor punctuators[] = {
+            ENUMERATE_TOKENS(ENUMERATE_TOKEN_DESCRIPTOR, ENUMERATE_NOTHING, ENUMERATE_NOTHING)
+        };
+
+        constexpr TokenDescriptor keywords[] = {
+            ENUMERATE_TOKENS(ENUMERATE_NOTHING, ENUMERATE_TOKEN_DESCRIPTOR, ENUMERATE_NOTHING)
+        };
+
+#undef ENUMERATE_TOKEN_DESCRIPTOR
+#undef ENUMERATE_NOTHING
+
+        constexpr std::string_view name(const TokenType type)
+        {
+            return all[static_cast<size_t>(type)].text;
+        }
+
+        // What the lexer should do with a byte when it sees it at the start of a token
+        enum class CharClass : uint8_t
+        {
+            INVALID,
+            WHITESPACE,
+            IDENTIFIER_START,
+            DIGIT,
+            QUOTE,
+            PUNCTUATOR
+        };
+
+        constexpr bool is_identifier_start(const char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$';
+        }
+
+        constexpr bool is_identifier_part(const char c)
+        {
+            return is_identifier_start(c) || (c >= '0' && c <= '9');
+        }
+
+        constexpr auto char_classes = []
+        {
+            std::array<CharClass, 256> table{};
+            for (size_t c = 0; c < 256; ++c)
+            {
+                const auto ch = static_cast<char>(c);
+                if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\v' || ch == '\f')
+                {
+                    table[c] = CharClass::WHITESPACE;
+                }
+                else if (is_identifier_start(ch))
+                {
+                    table[c] = CharClass::IDENTIFIER_START;
+                }
+                else if (ch >= '0' && ch <= '9')
+                {
+                    table[c] = CharClass::DIGIT;
+                }
+                else if (ch == '"' || ch == '\'')
+                {
+                    table[c] = CharClass::QUOTE;
+                }
+            }
+            for (const auto& punctuator : punctuators)
+            {
+                table[static_cast<unsigned char>(punctuator.text[0])] = CharClass::PUNCTUATOR;
+            }
+            return table;
+        }();
+
+        constexpr CharClass classify(const char c)
+        {
+            return char_classes[static_cast<unsigned char>(c)];
+        }
+
+        // Every punctuator sharing a first byte, longest first, so the first hit is the maximal munch
+        struct PunctuatorBucket
+        {
+            static constexpr size_t capacity = 6;
+
+            uint8_t count{0};
+            std::array<uint8_t, capacity> indices{};
+        };
+
+        constexpr auto punctuator_buckets = []
+        {
+            std::array<PunctuatorBucket, 256> buckets{};
+            for (size_t i = 0; i < std::size(punctuators); ++i)
+            {
+                auto& bucket = buckets[static_cast<unsigned char>(punctuators[i].text[0])];
+                if (bucket.count == PunctuatorBucket::capacity)
+                {
+                    throw "Too many punctuators share a first character";
+                }
+
+                // Insertion sort by descending length
+                size_t position = bucket.count++;
+                while (position > 0 && punctuators[bucket.indices[position - 1]].text.size() < punctuators[i].text.size())
+                {
+                    bucket.indices[position] = bucket.indices[position - 1];
+                    --position;
+                }
+                bucket.indices[position] = static_cast<uint8_t>(i);
+            }
+            return buckets;
+        }();
+
+        // Perfect hash over the keyword list: the seed is searched for at compile time, so a new keyword
+        // that collides just picks a different seed (or fails to compile if none exists)
+        constexpr size_t keyword_slot_count = 64;
+
+        constexpr uint32_t keyword_hash(const std::string_view word, const uint32_t seed)
+        {
+            const auto first = static_cast<unsigned char>(word[0]);
+            const auto second = static_cast<unsigned char>(word.size() > 1 ? word[1] : 0);
+            const auto last = static_cast<unsigned char>(word[word.size() - 1]);
+
+            uint32_t hash = static_cast<uint32_t>(word.size()) * 0x9E3779B1u;
+            hash ^= (first | (second << 8) | (last << 16)) * seed;
+            hash ^= hash >> 15;
+            return hash & (keyword_slot_count - 1);
+        }
+
+        constexpr uint8_t empty_keyword_slot = 0xFF;
+
+        struct KeywordHashTable
+        {
+            uint32_t seed;
+            std::array<uint8_t, keyword_slot_count> slots;
+        };
+
+        constexpr auto keyword_hash_table = []
+        {
+            for (uint32_t seed = 1; seed < 100000; seed += 2)
+            {
+                KeywordHashTable table{seed, {}};
+                table.slots.fill(empty_keyword_slot);
+
+                bool collided = false;
+                for (size_t i = 0; i < std::size(keywords) && !collided; ++i)
+                {
+                    auto& slot = table.slots[keyword_hash(keywords[i].text, seed)];
+                    collided = slot != empty_keyword_slot;
+                    slot = static_cast<uint8_t>(i);
+                }
+
+                if (!collided)
+                {
+                    return table;
+                }
+            }
+            throw "No perfect hash seed for the keyword table";
+        }();
+
+        static_assert(std::size(keywords) < keyword_slot_count / 2, "Grow keyword_slot_count");
+
+        // Returns the keyword's TokenType, or IDENTIFIER if the word is not a keyword
+        constexpr TokenType keyword_or_identifier(const std::string_view word)
+        {
+            const auto index = keyword_hash_table.slots[keyword_hash(word, keyword_hash_table.seed)];
+            if (index != empty_keyword_slot && keywords[index].text == word)
+            {
+                return keywords[index].type;
+            }
+            return TokenType::IDENTIFIER;
+        }
+
+        static_assert(keyword_or_identifier("function") == TokenType::FUNCTION);
+        static_assert(keyword_or_identifier("functions") == TokenType::IDENTIFIER);
+        static_assert(keyword_or_identifier("vart") == TokenType::IDENTIFIER);
+    }
+
+    // Fixed-size bit set of token types, built at compile time, so "is the next token one of these" is a shift and a mask
+    class TokenSet
+    {
+    public:
+        template <std::same_as<TokenType>... Types>
+        constexpr explicit TokenSet(const Types... types)
+        {
+            (add(types), ...);
+        }
+
+        [[nodiscard]] constexpr bool contains(const TokenType type) const
+        {
+            const auto index = static_cast<size_t>(type);
+            return (m_words[index / 64] >> (index % 64)) & 1;
+        }
+
+        [[nodiscard]] constexpr TokenSet operator|(const TokenSet& other) const
+        {
+            TokenSet result = *this;
+            for (size_t i = 0; i < word_count; ++i)
+            {
+                result.m_words[i] |= other.m_words[i];
+            }
+            return result;
+        }
+
+    private:
+        static constexpr size_t word_count = (std::size(TokenTable::all) + 63) / 64;
+
+        constexpr void add(const TokenType type)
+        {
+            const auto index = static_cast<size_t>(type);
+            m_words[index / 64] |= uint64_t{1} << (index % 64);
+        }
+
+        std::array<uint64_t, word_count> m_words{};
+    };
+
+    static_assert(TokenSet(TokenType::LET, TokenType::VAR).contains(TokenType::VAR));
+    static_assert(!TokenSet(TokenType::LET, TokenType::VAR).contains(TokenType::CONST));
+}
+
+#endif //TOKEN_TABLE_H
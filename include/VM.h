@@ -0,0 +1,60 @@
+#ifndef VM_H
+#define VM_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "AST.h"
+#include "Bytecode.h"
+#include "Heap.h"
+#include "Scope.h"
+#include "Value.h"
+
+namespace JS
+{
+    // Runs bytecode over one contiguous register file: a call's frame is the window of registers just past its
+    // caller's, so calling a function is copying its arguments and moving the window
+    class VM
+    {
+    public:
+        VM();
+
+        // Compiles and runs the program's top level. The tree (and this VM) must outlive any function the program
+        // left in a global. The result is only good until the next run, which may collect it
+        Value run(const AST& ast);
+
+        // Names the program can use without declaring them, like the native print
+        void set_global(Atom name, Value value);
+
+    private:
+        struct Frame
+        {
+            FunctionCode* function;
+            // Where the frame resumes once the call it made returns
+            const uint32_t* pc;
+            // The frame's first register in m_registers
+            size_t base;
+            // Innermost runtime scope, null until one is needed
+            Scope* scope;
+            // The caller's register the result goes in
+            uint32_t return_register;
+        };
+
+        // Runs the function in a new frame until that frame returns
+        Value execute(FunctionCode& function, Scope* scope);
+        // Only safe where every live cell is reachable from a register, a frame or a global
+        void collect_garbage();
+
+        static constexpr size_t max_call_depth = 10'000;
+
+        Heap m_heap;
+        std::vector<Value> m_registers;
+        std::vector<Frame> m_frames;
+        std::unordered_map<Atom, Value> m_globals;
+        // Every program run so far; closures point into their code
+        std::vector<std::unique_ptr<FunctionCode>> m_programs;
+    };
+}
+
+#endif //VM_H
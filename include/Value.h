@@ -1,18 +1,85 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <format>
 #include <functional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
-#include <variant>
+#include <vector>
+
+#include "Atom.h"
+
+#include "magic_enum/magic_enum.hpp"
 
 namespace JS
 {
+    class Tracer;
+
+    // Anything a Value can't hold inline. Cells are allocated in a Heap, which frees them once nothing reaches them
+    // and may move them until then
+    class Cell
+    {
+    public:
+        enum class Kind : uint8_t
+        {
+            STRING,
+            ARRAY,
+            OBJECT,
+            NATIVE_FUNCTION,
+            CLOSURE,
+            SCOPE
+        };
+
+        explicit Cell(const Kind kind) : m_kind(kind) {}
+        Cell& operator=(const Cell&) = delete;
+        virtual ~Cell() = default;
+
+        [[nodiscard]] Kind kind() const { return m_kind; }
+
+        // Visits every Value and Cell pointer this cell holds. Storing one into a cell after allocating it has to
+        // go through Heap::write_barrier
+        virtual void visit_edges(Tracer&) {}
+        // A copy made with new that takes over this cell's contents, which is how a young cell that survives a
+        // collection moves to the old space
+        virtual Cell* promote() = 0;
+
+    protected:
+        // The moved cell gets a header of its own
+        Cell(Cell&& other) noexcept : m_kind(other.m_kind) {}
+
+    private:
+        friend class Heap;
+        friend class Tracer;
+
+        Kind m_kind;
+        bool m_marked{false};
+        // In the remembered set, see Heap::write_barrier
+        bool m_remembered{false};
+        uint32_t m_size{0};
+        // The next old cell, or for a young cell that has been promoted, where it went
+        Cell* m_next{nullptr};
+    };
+
+    struct StringCell;
+
+    // 8 bytes, NaN-boxed: a number is its own bits, everything else hides in the payload of a negative quiet NaN,
+    // which arithmetic never produces once NaNs are canonicalized. The three bits below the quiet bit say what the
+    // low 48 hold: nothing, a boolean, an atom (strings known before running, which need no memory management) or
+    // a Cell pointer. Copying one is copying the word; what it points to is kept alive by the Heap tracing it
     class Value
     {
     public:
-        using Array = std::vector<std::shared_ptr<Value>>;
-        using Object = std::unordered_map<std::string, std::shared_ptr<Value>>;
-        using Function = std::function<std::shared_ptr<Value>(std::vector<std::shared_ptr<Value>>)>; // TODO
+        using Array = std::vector<Value>;
+        using Object = std::unordered_map<Atom, Value>;
+        // Gets the arguments in place in the caller's registers
+        using Function = std::function<Value(std::span<const Value>)>;
 
         enum class Type
         {
@@ -23,67 +90,204 @@ namespace JS
             ARRAY,
             OBJECT,
             UNDEFINED,
-            NAN,
-            NIL, // Aka null
-            INFINITY,
-            NEG_INFINITY
+            NIL // Aka null
         };
 
-        Value() : m_type(Type::UNDEFINED) {}
-        explicit Value(const std::string& str) : m_type(Type::STRING), m_data(str) {}
-        explicit Value(double num) : m_type(Type::NUMBER), m_data(num) {}
-        explicit Value(bool boolean) : m_type(Type::BOOLEAN), m_data(boolean) {}
-        explicit Value(Array array) : m_type(Type::ARRAY), m_data(array) {}
-        explicit Value(Function func) : m_type(Type::FUNCTION), m_data(func) {}
-        explicit Value(Object obj) : m_type(Type::OBJECT), m_data(obj) {}
-        explicit Value(std::nullptr_t) : m_type(Type::NIL) {}
-        explicit Value(const Type special_type)
+        Value() : m_bits(box(Tag::UNDEFINED)) {}
+        explicit Value(const double number) : m_bits(number == number ? std::bit_cast<uint64_t>(number) : canonical_nan) {}
+        explicit Value(const bool boolean) : m_bits(box(Tag::BOOLEAN, boolean)) {}
+        explicit Value(std::nullptr_t) : m_bits(box(Tag::NIL)) {}
+        // An interned string
+        explicit Value(const Atom atom) : m_bits(box(Tag::ATOM, atom.id())) {}
+        // These allocate in Heap::current(). Without one (the parser folding constants, say) a string is interned
+        // instead, since no collector would ever free it; the others throw
+        explicit Value(std::string string);
+        explicit Value(Array array);
+        explicit Value(Object object);
+        explicit Value(Function function);
+        explicit Value(Cell* cell) : m_bits(box(Tag::CELL, reinterpret_cast<uintptr_t>(cell)))
+        {
+            assert((reinterpret_cast<uintptr_t>(cell) & ~payload_mask) == 0);
+        }
+
+        [[nodiscard]] bool is_number() const { return (m_bits & box_prefix) != box_prefix; }
+
+        [[nodiscard]] Type type() const
         {
-            switch(special_type)
+            if(is_number())
             {
-            case Type::INFINITY:
-            case Type::NEG_INFINITY:
-            case Type::NAN:
-            case Type::UNDEFINED:
-                m_type = special_type;
-            default:
-                throw std::runtime_error("Invalid Value type");
+                return Type::NUMBER;
+            }
+
+            switch(tag())
+            {
+            case Tag::UNDEFINED:
+                return Type::UNDEFINED;
+            case Tag::NIL:
+                return Type::NIL;
+            case Tag::BOOLEAN:
+                return Type::BOOLEAN;
+            case Tag::ATOM:
+                return Type::STRING;
+            case Tag::CELL:
+                break;
             }
+
+            switch(cell()->kind())
+            {
+            case Cell::Kind::STRING:
+                return Type::STRING;
+            case Cell::Kind::ARRAY:
+                return Type::ARRAY;
+            case Cell::Kind::NATIVE_FUNCTION:
+            case Cell::Kind::CLOSURE:
+                return Type::FUNCTION;
+            case Cell::Kind::OBJECT:
+            // Scopes are never held by a Value
+            case Cell::Kind::SCOPE:
+                break;
+            }
+            return Type::OBJECT;
         }
 
+        // double, bool, std::string_view (any string), or a Cell type
         template<typename T>
-        T& as()
+        [[nodiscard]] bool is() const
         {
-            if(!std::holds_alternative<T>(m_data))
+            if constexpr(std::is_same_v<T, double>)
             {
-                throw std::runtime_error("Failed to unwrap Value");
+                return is_number();
+            } else if constexpr(std::is_same_v<T, bool>)
+            {
+                return has_tag(Tag::BOOLEAN);
+            } else if constexpr(std::is_same_v<T, std::string_view>)
+            {
+                return has_tag(Tag::ATOM) || is<StringCell>();
+            } else if constexpr(std::is_same_v<T, Cell>)
+            {
+                return has_tag(Tag::CELL);
+            } else
+            {
+                return has_tag(Tag::CELL) && cell()->kind() == T::cell_kind;
             }
-
-            return std::get<T>(m_data);
         }
 
+        // Numbers, booleans and strings by value, cells by reference
         template<typename T>
-        const T& as() const
+        [[nodiscard]] decltype(auto) as() const
         {
-            if(!std::holds_alternative<T>(m_data))
+            if(!is<T>())
             {
                 throw std::runtime_error("Failed to unwrap Value");
             }
 
-            return std::get<T>(m_data);
+            if constexpr(std::is_same_v<T, double>)
+            {
+                return std::bit_cast<double>(m_bits);
+            } else if constexpr(std::is_same_v<T, bool>)
+            {
+                return payload() != 0;
+            } else if constexpr(std::is_same_v<T, std::string_view>)
+            {
+                return string_view();
+            } else
+            {
+                return static_cast<T&>(*cell());
+            }
         }
 
-        std::string to_string() const
+        [[nodiscard]] std::string to_string() const
         {
-            return "";
+            switch(type())
+            {
+            case Type::NUMBER:
+                return std::format("{}", as<double>());
+            case Type::BOOLEAN:
+                return as<bool>() ? "true" : "false";
+            case Type::STRING:
+                return std::format("\"{}\"", as<std::string_view>());
+            case Type::UNDEFINED:
+                return "undefined";
+            case Type::NIL:
+                return "null";
+            default:
+                return std::format("[{}]", magic_enum::enum_name(type()));
+            }
         }
 
-        Type type() const { return m_type; }
-
     private:
-        Type m_type;
-        std::variant<std::monostate, std::string, double, Array, Object, Function, bool> m_data {std::monostate{}};
+        enum class Tag : uint64_t
+        {
+            UNDEFINED,
+            NIL,
+            BOOLEAN,
+            ATOM,
+            CELL
+        };
+
+        // Sign, exponent and quiet bit set
+        static constexpr uint64_t box_prefix = 0xFFF8'0000'0000'0000;
+        static constexpr uint64_t tag_shift = 48;
+        static constexpr uint64_t tag_mask = uint64_t{7} << tag_shift;
+        static constexpr uint64_t payload_mask = (uint64_t{1} << tag_shift) - 1;
+        static constexpr uint64_t canonical_nan = 0x7FF8'0000'0000'0000;
+
+        static constexpr uint64_t box(const Tag tag, const uint64_t payload = 0)
+        {
+            return box_prefix | static_cast<uint64_t>(tag) << tag_shift | payload;
+        }
+
+        [[nodiscard]] Tag tag() const { return static_cast<Tag>((m_bits & tag_mask) >> tag_shift); }
+        [[nodiscard]] bool has_tag(const Tag tag) const { return (m_bits & (box_prefix | tag_mask)) == box(tag); }
+        [[nodiscard]] uint64_t payload() const { return m_bits & payload_mask; }
+        [[nodiscard]] Cell* cell() const { return reinterpret_cast<Cell*>(payload()); }
+        [[nodiscard]] std::string_view string_view() const;
+
+        uint64_t m_bits;
+    };
+
+    static_assert(sizeof(Value) == 8);
+    static_assert(std::is_trivially_copyable_v<Value> && std::is_trivially_destructible_v<Value>);
+
+    struct StringCell final : Cell
+    {
+        static constexpr auto cell_kind = Kind::STRING;
+        explicit StringCell(std::string string) : Cell(cell_kind), string(std::move(string)) {}
+        Cell* promote() override { return new StringCell(std::move(*this)); }
+        std::string string;
+    };
+
+    struct ArrayCell final : Cell
+    {
+        static constexpr auto cell_kind = Kind::ARRAY;
+        explicit ArrayCell(Value::Array elements) : Cell(cell_kind), elements(std::move(elements)) {}
+        void visit_edges(Tracer& tracer) override;
+        Cell* promote() override { return new ArrayCell(std::move(*this)); }
+        Value::Array elements;
     };
+
+    struct ObjectCell final : Cell
+    {
+        static constexpr auto cell_kind = Kind::OBJECT;
+        explicit ObjectCell(Value::Object properties) : Cell(cell_kind), properties(std::move(properties)) {}
+        void visit_edges(Tracer& tracer) override;
+        Cell* promote() override { return new ObjectCell(std::move(*this)); }
+        Value::Object properties;
+    };
+
+    // Values the function captures are invisible to the collector, so it mustn't capture any that hold cells
+    struct NativeFunctionCell final : Cell
+    {
+        static constexpr auto cell_kind = Kind::NATIVE_FUNCTION;
+        explicit NativeFunctionCell(Value::Function function) : Cell(cell_kind), function(std::move(function)) {}
+        Cell* promote() override { return new NativeFunctionCell(std::move(*this)); }
+        Value::Function function;
+    };
+
+    inline std::string_view Value::string_view() const
+    {
+        return has_tag(Tag::ATOM) ? Atom(static_cast<uint32_t>(payload())).name() : std::string_view(static_cast<StringCell*>(cell())->string);
+    }
 }
 
 
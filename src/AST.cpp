@@ -1 +1,33 @@
+#include "AST.h"
 
+#include "Parser.h"
+#include "Resolver.h"
+
+namespace JS
+{
+    // Arena teardown skips these, so they must not own anything
+    static_assert(std::is_trivially_destructible_v<AST::Literal>);
+    static_assert(std::is_trivially_destructible_v<AST::BinaryExpression>);
+    static_assert(std::is_trivially_destructible_v<AST::FunctionDeclaration>);
+    static_assert(std::is_trivially_destructible_v<AST::BlockStatement>);
+
+    AST::BlockStatement* AST::FunctionDeclaration::body() const
+    {
+        if(!m_body)
+        {
+            m_body = Parser::parse_lazy_body(*m_arena, {m_span.file_id, m_span.start + m_body_offset, m_span.end}, *m_options);
+            if(m_enclosing_scope)
+            {
+                // The rest of the tree was resolved while this body was skipped
+                Resolver(*m_arena).resolve_function(*this);
+            }
+        }
+
+        return m_body;
+    }
+
+    std::string AST::VariableDeclaration::to_string()
+    {
+        return std::format("VariableDeclaration [kind={}, name={}, value={}]", magic_enum::enum_name(m_declaration_kind), m_name.name(), m_initial_value ? m_initial_value->to_string() : "undefined");
+    }
+}
@@ -0,0 +1,36 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <ranges>
+
+namespace JS
+{
+    Arena::~Arena()
+    {
+        // Newest first, like the destructors of stack objects
+        for (const auto& [object, destroy] : std::views::reverse(m_finalizers))
+        {
+            destroy(object);
+        }
+    }
+
+    void* Arena::allocate_slow(const size_t size, const size_t alignment)
+    {
+        const auto needed = size + alignment - 1;
+
+        // Big requests get a chunk to themselves so the rest of the current chunk isn't thrown away
+        if (needed > m_next_chunk_size / 4)
+        {
+            auto& chunk = m_chunks.emplace_back(std::make_unique_for_overwrite<std::byte[]>(needed));
+            const auto aligned = (reinterpret_cast<uintptr_t>(chunk.get()) + alignment - 1) & ~(alignment - 1);
+            m_bytes_allocated += size;
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        auto& chunk = m_chunks.emplace_back(std::make_unique_for_overwrite<std::byte[]>(m_next_chunk_size));
+        m_cursor = chunk.get();
+        m_end = chunk.get() + m_next_chunk_size;
+        m_next_chunk_size = std::min(m_next_chunk_size * 2, max_chunk_size);
+        return allocate(size, alignment);
+    }
+}
@@ -0,0 +1,60 @@
+#include "Atom.h"
+
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+namespace JS
+{
+    AtomTable::AtomTable()
+    {
+        intern("");
+    }
+
+    Atom AtomTable::intern(const std::string_view name)
+    {
+        {
+            std::shared_lock lock(m_mutex);
+            if (const auto existing = m_ids.find(name); existing != m_ids.end())
+            {
+                return Atom{existing->second};
+            }
+        }
+
+        std::unique_lock lock(m_mutex);
+        // Someone may have interned it between the two locks
+        if (const auto existing = m_ids.find(name); existing != m_ids.end())
+        {
+            return Atom{existing->second};
+        }
+
+        if (m_count == std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("Too many atoms");
+        }
+
+        const auto id = m_count++;
+        auto& segment = m_segments[id >> segment_bits];
+        if (!segment.load(std::memory_order_relaxed))
+        {
+            segment.store(new Entry[segment_size], std::memory_order_release);
+        }
+
+        const std::string_view stored = m_names.emplace_back(name);
+        segment.load(std::memory_order_relaxed)[id & (segment_size - 1)] = {stored, hash(stored)};
+        m_ids.emplace(stored, id);
+        return Atom{id};
+    }
+
+    uint32_t AtomTable::hash(const std::string_view name)
+    {
+        // FNV-1a, identifiers are short enough that anything fancier doesn't pay off
+        uint32_t hash = 2166136261u;
+        for (const char c : name)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+}
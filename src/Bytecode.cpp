@@ -0,0 +1,29 @@
+#include "Bytecode.h"
+
+#include <sstream>
+
+namespace JS
+{
+    std::string FunctionCode::to_string() const
+    {
+        std::ostringstream str;
+        str << std::format("{} [registers={}, parameters={}]\n", name(), register_count, parameter_count);
+        for(size_t offset = 0; offset < code.size();)
+        {
+            const auto opcode = code[offset];
+            str << std::format("{:5}: {}", offset, opcode_names[opcode]);
+            for(size_t operand = 1; operand <= opcode_operand_counts[opcode]; ++operand)
+            {
+                str << std::format(" {}", code[offset + operand]);
+            }
+            if(static_cast<Opcode>(opcode) == Opcode::LOAD_CONSTANT)
+            {
+                str << std::format(" ({})", constants[code[offset + 2]].to_string());
+            }
+            str << "\n";
+            offset += 1 + opcode_operand_counts[opcode];
+        }
+
+        return str.str();
+    }
+}
@@ -0,0 +1,180 @@
+#include "CharScan.h"
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "TokenTable.h"
+
+namespace JS::CharScan
+{
+    namespace
+    {
+        constexpr bool is_whitespace(const char c)
+        {
+            return TokenTable::classify(c) == TokenTable::CharClass::WHITESPACE;
+        }
+
+#if defined(__AVX2__)
+        // Byte-wise unsigned (value - low) <= span, i.e. low <= value <= low + span
+        __m256i in_range_256(const __m256i bytes, const char low, const char span)
+        {
+            const __m256i shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8(low));
+            return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(span)), shifted);
+        }
+
+        __m256i whitespace_mask_256(const __m256i bytes)
+        {
+            return _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), in_range_256(bytes, '\t', '\r' - '\t'));
+        }
+
+        __m256i identifier_mask_256(const __m256i bytes)
+        {
+            // Setting bit 5 folds upper case onto lower case without pulling in any other printable character
+            const __m256i letters = in_range_256(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 'z' - 'a');
+            const __m256i digits = in_range_256(bytes, '0', '9' - '0');
+            const __m256i extras = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')),
+                                                   _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('$')));
+            return _mm256_or_si256(_mm256_or_si256(letters, digits), extras);
+        }
+
+        uint32_t mask_bits_256(const __m256i mask)
+        {
+            return static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+        }
+#endif
+
+#if defined(__SSE2__)
+        __m128i in_range_128(const __m128i bytes, const char low, const char span)
+        {
+            const __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+            return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(span)), shifted);
+        }
+
+        __m128i whitespace_mask_128(const __m128i bytes)
+        {
+            return _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), in_range_128(bytes, '\t', '\r' - '\t'));
+        }
+
+        __m128i identifier_mask_128(const __m128i bytes)
+        {
+            const __m128i letters = in_range_128(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z' - 'a');
+            const __m128i digits = in_range_128(bytes, '0', '9' - '0');
+            const __m128i extras = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')),
+                                                _mm_cmpeq_epi8(bytes, _mm_set1_epi8('$')));
+            return _mm_or_si128(_mm_or_si128(letters, digits), extras);
+        }
+
+        uint32_t mask_bits_128(const __m128i mask)
+        {
+            return static_cast<uint32_t>(_mm_movemask_epi8(mask));
+        }
+#endif
+    }
+
+    const char* skip_whitespace(const char* cursor, const char* const end)
+    {
+#if defined(__AVX2__)
+        while (end - cursor >= 32)
+        {
+            const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cursor));
+            if (const uint32_t stops = ~mask_bits_256(whitespace_mask_256(bytes)))
+            {
+                return cursor + std::countr_zero(stops);
+            }
+            cursor += 32;
+        }
+#endif
+#if defined(__SSE2__)
+        while (end - cursor >= 16)
+        {
+            const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+            if (const uint32_t stops = ~mask_bits_128(whitespace_mask_128(bytes)) & 0xFFFF)
+            {
+                return cursor + std::countr_zero(stops);
+            }
+            cursor += 16;
+        }
+#endif
+        while (cursor < end && is_whitespace(*cursor))
+        {
+            ++cursor;
+        }
+        return cursor;
+    }
+
+    const char* skip_identifier(const char* cursor, const char* const end)
+    {
+#if defined(__AVX2__)
+        while (end - cursor >= 32)
+        {
+            const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cursor));
+            if (const uint32_t stops = ~mask_bits_256(identifier_mask_256(bytes)))
+            {
+                return cursor + std::countr_zero(stops);
+            }
+            cursor += 32;
+        }
+#endif
+#if defined(__SSE2__)
+        while (end - cursor >= 16)
+        {
+            const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+            if (const uint32_t stops = ~mask_bits_128(identifier_mask_128(bytes)) & 0xFFFF)
+            {
+                return cursor + std::countr_zero(stops);
+            }
+            cursor += 16;
+        }
+#endif
+        while (cursor < end && TokenTable::is_identifier_part(*cursor))
+        {
+            ++cursor;
+        }
+        return cursor;
+    }
+
+    const char* find_string_stop(const char* cursor, const char* const end, const char quote)
+    {
+#if defined(__AVX2__)
+        while (end - cursor >= 32)
+        {
+            const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cursor));
+            const auto line_breaks = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')),
+                                                     _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')));
+            const auto hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(quote)),
+                                                              _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\\'))),
+                                              line_breaks);
+            if (const uint32_t stops = mask_bits_256(hits))
+            {
+                return cursor + std::countr_zero(stops);
+            }
+            cursor += 32;
+        }
+#endif
+#if defined(__SSE2__)
+        while (end - cursor >= 16)
+        {
+            const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+            const auto line_breaks = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')),
+                                                  _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')));
+            const auto hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(quote)),
+                                                        _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\'))),
+                                           line_breaks);
+            if (const uint32_t stops = mask_bits_128(hits))
+            {
+                return cursor + std::countr_zero(stops);
+            }
+            cursor += 16;
+        }
+#endif
+        while (cursor < end && *cursor != quote && *cursor != '\\' && *cursor != '\n' && *cursor != '\r')
+        {
+            ++cursor;
+        }
+        return cursor;
+    }
+}
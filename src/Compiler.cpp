@@ -0,0 +1,544 @@
+#include "Compiler.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace JS
+{
+    namespace
+    {
+        Opcode binary_opcode(const AST::BinaryExpression::Op op)
+        {
+            using Op = AST::BinaryExpression::Op;
+            switch(op)
+            {
+            case Op::PLUS: return Opcode::ADD;
+            case Op::MINUS: return Opcode::SUBTRACT;
+            case Op::MULT: return Opcode::MULTIPLY;
+            case Op::DIV: return Opcode::DIVIDE;
+            case Op::MOD: return Opcode::MODULO;
+            case Op::AND: return Opcode::BITWISE_AND;
+            case Op::OR: return Opcode::BITWISE_OR;
+            case Op::XOR: return Opcode::BITWISE_XOR;
+            case Op::SHIFT_LEFT: return Opcode::SHIFT_LEFT;
+            case Op::SHIFT_RIGHT: return Opcode::SHIFT_RIGHT;
+            case Op::EQUAL_EQUAL: return Opcode::LOOSELY_EQUAL;
+            case Op::NOT_EQUAL: return Opcode::LOOSELY_NOT_EQUAL;
+            case Op::EQUAL_EQUAL_EQUAL: return Opcode::STRICTLY_EQUAL;
+            case Op::NOT_EQUAL_EQUAL: return Opcode::STRICTLY_NOT_EQUAL;
+            case Op::LESS_THAN: return Opcode::LESS_THAN;
+            case Op::GREATER_THAN: return Opcode::GREATER_THAN;
+            case Op::LESS_THAN_EQUAL_TO: return Opcode::LESS_THAN_EQUAL_TO;
+            case Op::GREATER_THAN_EQUAL_TO: return Opcode::GREATER_THAN_EQUAL_TO;
+            default:
+                throw std::runtime_error(std::format("No opcode for binary operator {}", magic_enum::enum_name(op)));
+            }
+        }
+
+        Opcode unary_opcode(const AST::UnaryExpression::Op op)
+        {
+            using Op = AST::UnaryExpression::Op;
+            switch(op)
+            {
+            case Op::MINUS: return Opcode::NEGATE;
+            case Op::PLUS: return Opcode::TO_NUMBER;
+            case Op::NOT: return Opcode::NOT;
+            }
+
+            throw std::runtime_error(std::format("No opcode for unary operator {}", magic_enum::enum_name(op)));
+        }
+
+        // Whether evaluating expression can assign to a variable. Only assignments can: a call can't reach the
+        // registers of the caller, whatever it assigns from a nested function is in a runtime Scope
+        bool may_assign(const FlatAST& ast, const FlatAST::Index expression, std::vector<FlatAST::Index>& stack)
+        {
+            const auto base = stack.size();
+            stack.push_back(expression);
+            while(stack.size() > base)
+            {
+                const auto& current = ast.node(stack.back());
+                stack.pop_back();
+                switch(current.kind)
+                {
+                case AST::Kind::VARIABLE_ASSIGNMENT:
+                    stack.resize(base);
+                    return true;
+                case AST::Kind::BINARY_EXPRESSION:
+                    stack.push_back(current.a);
+                    stack.push_back(current.b);
+                    break;
+                case AST::Kind::UNARY_EXPRESSION:
+                    stack.push_back(current.a);
+                    break;
+                case AST::Kind::FUNCTION_CALL:
+                {
+                    const auto arguments = ast.list(current.b);
+                    stack.insert(stack.end(), arguments.begin(), arguments.end());
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+
+            return false;
+        }
+    }
+
+    std::unique_ptr<FunctionCode> Compiler::compile(const AST& ast)
+    {
+        if(!ast.program()->scope())
+        {
+            throw std::runtime_error("Compiling a program that hasn't been resolved");
+        }
+
+        auto program = std::make_unique<FunctionCode>();
+        const auto flat = FlatAST::build(*ast.program());
+        Compiler(*program, flat).compile_program();
+        return program;
+    }
+
+    void Compiler::compile_function(FunctionCode& function)
+    {
+        assert(function.declaration);
+        // Parses (and resolves) a lazy body
+        const auto flat = FlatAST::build(*function.declaration);
+        Compiler(function, flat).compile_function_body(*function.declaration);
+    }
+
+    void Compiler::compile_program()
+    {
+        const auto& program = m_ast.node(m_ast.root());
+        const auto statements = m_ast.list(program.a);
+        enter_scope(*m_ast.scope(program.b), statements);
+        compile_statements(statements);
+        emit(Opcode::RETURN_UNDEFINED);
+    }
+
+    void Compiler::compile_function_body(const AST::FunctionDeclaration& declaration)
+    {
+        if(!declaration.scope())
+        {
+            throw std::runtime_error(std::format("Compiling function {} which hasn't been resolved", declaration.name().name()));
+        }
+
+        const auto statements = m_ast.list(m_ast.node(m_ast.root()).a);
+        m_function.parameter_count = static_cast<uint32_t>(declaration.parameters().size());
+        enter_scope(*declaration.scope(), statements);
+        compile_statements(statements);
+        emit(Opcode::RETURN_UNDEFINED);
+    }
+
+    void Compiler::enter_scope(const ScopeInfo& scope, const std::span<const Index> statements)
+    {
+        // A function's scope comes first, so its parameters (its first slots) are in the first registers
+        const auto first_register = m_next_register;
+        m_scopes.push_back({&scope, first_register, m_first_temporary});
+        m_next_register += scope.slot_count();
+        m_function.register_count = std::max(m_function.register_count, m_next_register);
+        m_first_temporary = m_next_register;
+
+        if(scope.has_captured_bindings())
+        {
+            emit(Opcode::PUSH_SCOPE, {scope.slot_count()});
+            if(scope.kind() == ScopeInfo::Kind::FUNCTION)
+            {
+                for(uint32_t parameter = 0; parameter < m_function.parameter_count; ++parameter)
+                {
+                    if(scope.binding(parameter).captured)
+                    {
+                        emit(Opcode::SET_SCOPE, {0, parameter, first_register + parameter});
+                    }
+                }
+            }
+        }
+
+        for(const auto statement : statements)
+        {
+            const auto& node = m_ast.node(statement);
+            if(node.kind != AST::Kind::FUNCTION_DECLARATION)
+            {
+                continue;
+            }
+
+            const auto& declaration = m_ast.function(node.a);
+            auto function = std::make_unique<FunctionCode>();
+            function->declaration = &declaration;
+            const auto index = static_cast<uint32_t>(m_function.functions.size());
+            m_function.functions.push_back(std::move(function));
+
+            const auto closure = allocate_register();
+            emit(Opcode::MAKE_CLOSURE, {closure, index});
+            store(place_of(declaration.name(), declaration.location()), closure);
+            m_next_register = m_first_temporary;
+        }
+    }
+
+    void Compiler::exit_scope()
+    {
+        const auto [scope, first_register, first_temporary] = m_scopes.back();
+        m_scopes.pop_back();
+        if(scope->has_captured_bindings())
+        {
+            emit(Opcode::POP_SCOPE);
+        }
+
+        // The registers are free for whatever comes next; anything that outlives the scope was captured
+        m_next_register = first_register;
+        m_first_temporary = first_temporary;
+    }
+
+    void Compiler::compile_statements(const std::span<const Index> statements)
+    {
+        for(const auto statement : statements)
+        {
+            compile_statement(statement);
+            m_next_register = m_first_temporary;
+        }
+    }
+
+    void Compiler::compile_statement(const Index statement)
+    {
+        const auto& node = m_ast.node(statement);
+        switch(node.kind)
+        {
+        case AST::Kind::VARIABLE_DECLARATION:
+        {
+            const auto place = place_of(node);
+            if(node.b != FlatAST::none)
+            {
+                (void)store(place, node.b, {});
+            } else if(static_cast<AST::VariableDeclaration::DeclarationKind>(node.op) != AST::VariableDeclaration::DeclarationKind::VAR)
+            {
+                // Registers are reused, a let in a loop body must not see the last iteration's value
+                const auto undefined = place.kind == Place::Kind::REGISTER ? place.index : allocate_register();
+                emit(Opcode::LOAD_UNDEFINED, {undefined});
+                store(place, undefined);
+            }
+            break;
+        }
+        case AST::Kind::FUNCTION_DECLARATION:
+            // Hoisted, see enter_scope
+            break;
+        case AST::Kind::BLOCK_STATEMENT:
+            compile_block(statement);
+            break;
+        case AST::Kind::IF_STATEMENT:
+        {
+            const auto condition = compile_expression(node.a);
+            const auto to_alternate = emit_jump(Opcode::JUMP_IF_FALSE, {condition});
+            m_next_register = m_first_temporary;
+
+            compile_block(node.b);
+            if(node.c == FlatAST::none)
+            {
+                patch(to_alternate);
+                break;
+            }
+
+            const auto to_end = emit_jump(Opcode::JUMP);
+            patch(to_alternate);
+            compile_block(node.c);
+            patch(to_end);
+            break;
+        }
+        case AST::Kind::WHILE_STATEMENT:
+        case AST::Kind::FOR_STATEMENT:
+        {
+            // The parser only builds a for statement's condition and body, which makes it a while loop
+            const auto start = static_cast<uint32_t>(m_function.code.size());
+            std::optional<size_t> to_end;
+            // while(true) doesn't need testing; a false literal condition was already folded away with the loop
+            if(m_ast.node(node.a).kind != AST::Kind::LITERAL)
+            {
+                to_end = emit_jump(Opcode::JUMP_IF_FALSE, {compile_expression(node.a)});
+                m_next_register = m_first_temporary;
+            }
+
+            compile_block(node.b);
+            emit(Opcode::JUMP, {start});
+            if(to_end)
+            {
+                patch(*to_end);
+            }
+            break;
+        }
+        case AST::Kind::RETURN_STATEMENT:
+            if(node.a != FlatAST::none)
+            {
+                emit(Opcode::RETURN, {compile_expression(node.a)});
+            } else
+            {
+                emit(Opcode::RETURN_UNDEFINED);
+            }
+            break;
+        case AST::Kind::EXPRESSION_STATEMENT:
+            (void)compile_expression(node.a);
+            break;
+        default:
+            throw std::runtime_error(std::format("Can't compile a {}", magic_enum::enum_name(node.kind)));
+        }
+    }
+
+    void Compiler::compile_block(const Index block)
+    {
+        const auto& node = m_ast.node(block);
+        const auto statements = m_ast.list(node.a);
+        const auto* scope = m_ast.scope(node.b);
+        if(!scope)
+        {
+            compile_statements(statements);
+            return;
+        }
+
+        enter_scope(*scope, statements);
+        compile_statements(statements);
+        exit_scope();
+    }
+
+    uint32_t Compiler::compile_expression(const Index expression, const std::optional<uint32_t> into)
+    {
+        const auto& node = m_ast.node(expression);
+        switch(node.kind)
+        {
+        case AST::Kind::LITERAL:
+        {
+            const auto destination = into.value_or(allocate_register());
+            emit(Opcode::LOAD_CONSTANT, {destination, add_constant(m_ast.literal(node.a))});
+            return destination;
+        }
+        case AST::Kind::VARIABLE_EXPRESSION:
+            return load(place_of(node), into);
+        case AST::Kind::VARIABLE_ASSIGNMENT:
+            return store(place_of(node), node.b, into);
+        case AST::Kind::UNARY_EXPRESSION:
+        {
+            const auto operand = compile_expression(node.a);
+            const auto destination = into.value_or(allocate_register());
+            emit(unary_opcode(static_cast<AST::UnaryExpression::Op>(node.op)), {destination, operand});
+            return destination;
+        }
+        case AST::Kind::BINARY_EXPRESSION:
+            return compile_binary_expression(expression, into);
+        case AST::Kind::FUNCTION_CALL:
+            return compile_function_call(expression, into);
+        default:
+            throw std::runtime_error(std::format("Can't compile a {}", magic_enum::enum_name(node.kind)));
+        }
+    }
+
+    uint32_t Compiler::compile_binary_expression(const Index expression, const std::optional<uint32_t> into)
+    {
+        // Operator chains nest to the left (a + b + c is (a + b) + c) and can be arbitrarily long, so the left
+        // spine is walked in a loop; right operands only nest as deep as the parser allows
+        std::vector<const FlatAST::Node*> spine;
+        auto leftmost = expression;
+        while(m_ast.node(leftmost).kind == AST::Kind::BINARY_EXPRESSION)
+        {
+            spine.push_back(&m_ast.node(leftmost));
+            leftmost = spine.back()->a;
+        }
+
+        auto accumulator = compile_expression(leftmost);
+        std::optional<uint32_t> intermediate;
+        for(auto binary = spine.rbegin(); binary != spine.rend(); ++binary)
+        {
+            const auto left = protect(accumulator, (*binary)->b);
+            const auto right = compile_expression((*binary)->b);
+
+            // into may be a variable the operands still read, so only the last operator writes it
+            uint32_t destination;
+            if(into && binary + 1 == spine.rend())
+            {
+                destination = *into;
+            } else
+            {
+                if(!intermediate)
+                {
+                    intermediate = allocate_register();
+                }
+                destination = *intermediate;
+            }
+
+            emit(binary_opcode(static_cast<AST::BinaryExpression::Op>((*binary)->op)), {destination, left, right});
+            accumulator = destination;
+        }
+
+        return accumulator;
+    }
+
+    uint32_t Compiler::compile_function_call(const Index call, const std::optional<uint32_t> into)
+    {
+        const auto& node = m_ast.node(call);
+        auto callee = load(place_of(node), {});
+        const auto arguments = m_ast.list(node.b);
+        for(const auto argument : arguments)
+        {
+            callee = protect(callee, argument);
+        }
+
+        // Arguments go in consecutive registers, which the VM copies into the callee's parameters
+        const auto first_argument = m_next_register;
+        for(size_t i = 0; i < arguments.size(); ++i)
+        {
+            (void)allocate_register();
+        }
+        for(size_t i = 0; i < arguments.size(); ++i)
+        {
+            (void)compile_expression(arguments[i], first_argument + static_cast<uint32_t>(i));
+        }
+
+        const auto destination = into.value_or(allocate_register());
+        emit(Opcode::CALL, {destination, callee, first_argument, static_cast<uint32_t>(arguments.size())});
+        return destination;
+    }
+
+    uint32_t Compiler::load(const Place& place, const std::optional<uint32_t> into)
+    {
+        switch(place.kind)
+        {
+        case Place::Kind::REGISTER:
+            if(into && *into != place.index)
+            {
+                emit(Opcode::MOVE, {*into, place.index});
+                return *into;
+            }
+            return place.index;
+        case Place::Kind::SCOPE:
+        {
+            const auto destination = into.value_or(allocate_register());
+            emit(Opcode::GET_SCOPE, {destination, place.index, place.slot});
+            return destination;
+        }
+        case Place::Kind::GLOBAL:
+        {
+            const auto destination = into.value_or(allocate_register());
+            emit(Opcode::GET_GLOBAL, {destination, place.index});
+            return destination;
+        }
+        }
+
+        return 0;
+    }
+
+    uint32_t Compiler::store(const Place& place, const Index value, const std::optional<uint32_t> into)
+    {
+        if(place.kind == Place::Kind::REGISTER)
+        {
+            // Computed straight into the variable's register
+            const auto result = compile_expression(value, place.index);
+            if(into && *into != result)
+            {
+                emit(Opcode::MOVE, {*into, result});
+                return *into;
+            }
+            return result;
+        }
+
+        const auto result = compile_expression(value, into);
+        store(place, result);
+        return result;
+    }
+
+    void Compiler::store(const Place& place, const uint32_t value)
+    {
+        switch(place.kind)
+        {
+        case Place::Kind::REGISTER:
+            if(place.index != value)
+            {
+                emit(Opcode::MOVE, {place.index, value});
+            }
+            break;
+        case Place::Kind::SCOPE:
+            emit(Opcode::SET_SCOPE, {place.index, place.slot, value});
+            break;
+        case Place::Kind::GLOBAL:
+            emit(Opcode::SET_GLOBAL, {place.index, value});
+            break;
+        }
+    }
+
+    Compiler::Place Compiler::place_of(const FlatAST::Node& node) const
+    {
+        return place_of(FlatAST::atom(node.a), m_ast.location(node.c));
+    }
+
+    Compiler::Place Compiler::place_of(const Atom name, const VariableLocation& location) const
+    {
+        if(!location.is_resolved())
+        {
+            return {Place::Kind::GLOBAL, name.id()};
+        }
+
+        // The Resolver counted every scope on the way; at runtime only the ones with captured bindings exist
+        const ScopeInfo* scope = m_scopes.back().scope;
+        uint32_t scope_hops = 0;
+        for(uint32_t hop = 0; hop < location.hops; ++hop)
+        {
+            scope_hops += scope->has_captured_bindings();
+            scope = scope->parent();
+        }
+
+        if(scope->binding(location.slot).captured)
+        {
+            return {Place::Kind::SCOPE, scope_hops, location.slot};
+        }
+
+        // Bindings of enclosing functions are only ever reached by capturing them, so this one is ours
+        const auto owner = std::ranges::find(m_scopes, scope, &ScopeRegisters::scope);
+        if(owner == m_scopes.end())
+        {
+            throw std::runtime_error(std::format("{} refers to a binding of another function that isn't captured", name.name()));
+        }
+        return {Place::Kind::REGISTER, owner->first_register + location.slot};
+    }
+
+    uint32_t Compiler::protect(const uint32_t value, const Index later)
+    {
+        if(value >= m_first_temporary || !may_assign(m_ast, later, m_expression_stack))
+        {
+            return value;
+        }
+
+        const auto copy = allocate_register();
+        emit(Opcode::MOVE, {copy, value});
+        return copy;
+    }
+
+    uint32_t Compiler::allocate_register()
+    {
+        const auto allocated = m_next_register++;
+        m_function.register_count = std::max(m_function.register_count, m_next_register);
+        return allocated;
+    }
+
+    uint32_t Compiler::add_constant(const Value& value)
+    {
+        // Constants aren't roots, literals never point into a heap
+        assert(!value.is<Cell>());
+        m_function.constants.push_back(value);
+        return static_cast<uint32_t>(m_function.constants.size() - 1);
+    }
+
+    void Compiler::emit(const Opcode opcode, const std::initializer_list<uint32_t> operands)
+    {
+        assert(operands.size() == opcode_operand_counts[static_cast<size_t>(opcode)]);
+        m_function.code.push_back(static_cast<uint32_t>(opcode));
+        m_function.code.insert(m_function.code.end(), operands);
+    }
+
+    size_t Compiler::emit_jump(const Opcode opcode, const std::initializer_list<uint32_t> operands)
+    {
+        assert(operands.size() + 1 == opcode_operand_counts[static_cast<size_t>(opcode)]);
+        m_function.code.push_back(static_cast<uint32_t>(opcode));
+        m_function.code.insert(m_function.code.end(), operands);
+        m_function.code.push_back(0);
+        return m_function.code.size() - 1;
+    }
+
+    void Compiler::patch(const size_t jump)
+    {
+        m_function.code[jump] = static_cast<uint32_t>(m_function.code.size());
+    }
+}
@@ -0,0 +1,83 @@
+#include "FileTable.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace JS
+{
+    FileId FileTable::add(std::string name, const std::span<const char> source)
+    {
+        if (m_files.size() > std::numeric_limits<FileId>::max())
+        {
+            throw std::runtime_error("Too many source files");
+        }
+        if (source.size() > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("Source file too large");
+        }
+
+        auto& file = m_files.emplace_back();
+        file.name = std::move(name);
+        file.source = source;
+        file.build_line_starts();
+        return static_cast<FileId>(m_files.size() - 1);
+    }
+
+    FileId FileTable::add(std::string name, SourceBuffer source)
+    {
+        const auto bytes = source.bytes();
+        const auto id = add(std::move(name), bytes);
+        m_files[id].owned_source.emplace(std::move(source));
+        return id;
+    }
+
+    void FileTable::replace(const FileId id, const std::span<const char> source)
+    {
+        if (source.size() > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("Source file too large");
+        }
+
+        auto& file = m_files[id];
+        file.source = source;
+        file.owned_source.reset();
+        file.build_line_starts();
+    }
+
+    void FileTable::replace(const FileId id, SourceBuffer source)
+    {
+        replace(id, source.bytes());
+        m_files[id].owned_source.emplace(std::move(source));
+    }
+
+    FilePosition SourceFile::position_of(const uint32_t offset) const
+    {
+        // Only diagnostics ask for this, so nothing is tracked while lexing; find the last line starting at or
+        // before the offset
+        const auto line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin() - 1;
+        return {static_cast<size_t>(line), offset - line_starts[line], offset};
+    }
+
+    void SourceFile::build_line_starts()
+    {
+        line_starts.clear();
+        line_starts.push_back(0);
+
+        // memchr is vectorized by the C library, so this runs at memory bandwidth rather than a byte per iteration
+        const char* const begin = source.data();
+        const char* const end = begin + source.size();
+        const char* cursor = begin;
+        while (cursor < end)
+        {
+            const auto* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+            if (!newline)
+            {
+                break;
+            }
+            cursor = newline + 1;
+            line_starts.push_back(static_cast<uint32_t>(cursor - begin));
+        }
+    }
+}
@@ -0,0 +1,227 @@
+#include "FlatAST.h"
+
+namespace JS
+{
+    namespace
+    {
+        // Calls visit with each child of node in source order; absent optional children are passed as nullptr so
+        // every node of a kind has the same number of children. A function declaration has none, its body is a
+        // compilation unit of its own
+        template <typename F>
+        void for_each_child(const AST::Node& node, F&& visit)
+        {
+            switch(node.kind())
+            {
+            case AST::Kind::PROGRAM:
+                for(const auto* statement : static_cast<const AST::Program&>(node).statements())
+                {
+                    visit(statement);
+                }
+                break;
+            case AST::Kind::BLOCK_STATEMENT:
+                for(const auto* statement : static_cast<const AST::BlockStatement&>(node).statements())
+                {
+                    visit(statement);
+                }
+                break;
+            case AST::Kind::FUNCTION_CALL:
+                for(const auto* argument : static_cast<const AST::FunctionCall&>(node).arguments())
+                {
+                    visit(argument);
+                }
+                break;
+            case AST::Kind::BINARY_EXPRESSION:
+            {
+                const auto& binary = static_cast<const AST::BinaryExpression&>(node);
+                visit(&binary.left());
+                visit(&binary.right());
+                break;
+            }
+            case AST::Kind::UNARY_EXPRESSION:
+                visit(&static_cast<const AST::UnaryExpression&>(node).operand());
+                break;
+            case AST::Kind::VARIABLE_ASSIGNMENT:
+                visit(&static_cast<const AST::VariableAssignment&>(node).value());
+                break;
+            case AST::Kind::VARIABLE_DECLARATION:
+                visit(static_cast<const AST::VariableDeclaration&>(node).initial_value());
+                break;
+            case AST::Kind::IF_STATEMENT:
+            {
+                const auto& if_statement = static_cast<const AST::IfStatement&>(node);
+                visit(&if_statement.condition());
+                visit(&if_statement.body());
+                visit(if_statement.alternate());
+                break;
+            }
+            case AST::Kind::WHILE_STATEMENT:
+            {
+                const auto& while_statement = static_cast<const AST::WhileStatement&>(node);
+                visit(&while_statement.condition());
+                visit(&while_statement.body());
+                break;
+            }
+            case AST::Kind::FOR_STATEMENT:
+            {
+                const auto& for_statement = static_cast<const AST::ForStatement&>(node);
+                visit(&for_statement.condition());
+                visit(&for_statement.body());
+                break;
+            }
+            case AST::Kind::RETURN_STATEMENT:
+                visit(static_cast<const AST::ReturnStatement&>(node).value());
+                break;
+            case AST::Kind::EXPRESSION_STATEMENT:
+                visit(&static_cast<const AST::ExpressionStatement&>(node).expression());
+                break;
+            case AST::Kind::FUNCTION_DECLARATION:
+            case AST::Kind::PARAMETER:
+            case AST::Kind::LITERAL:
+            case AST::Kind::VARIABLE_EXPRESSION:
+                break;
+            }
+        }
+    }
+
+    FlatAST FlatAST::build(const AST::Program& program)
+    {
+        FlatAST flat;
+        flat.flatten(program);
+        return flat;
+    }
+
+    FlatAST FlatAST::build(const AST::FunctionDeclaration& function)
+    {
+        FlatAST flat;
+        flat.flatten(*function.body());
+        return flat;
+    }
+
+    void FlatAST::flatten(const AST::Node& root)
+    {
+        // Post-order walk with an explicit stack: operator chains can be far deeper than the native stack allows.
+        // A node is visited twice, first to queue its children and then, once their indices are the top
+        // child_count of results, to emit it
+        struct Frame
+        {
+            const AST::Node* node;
+            bool children_done;
+            uint32_t child_count{0};
+        };
+
+        std::vector<Frame> work{{&root, false}};
+        std::vector<Index> results;
+        std::vector<const AST::Node*> children;
+        while(!work.empty())
+        {
+            const auto frame = work.back();
+            work.pop_back();
+            if(!frame.node)
+            {
+                results.push_back(none);
+                continue;
+            }
+
+            if(frame.children_done)
+            {
+                const auto first = results.size() - frame.child_count;
+                const auto index = emit(*frame.node, std::span(results).subspan(first));
+                results.resize(first);
+                results.push_back(index);
+                continue;
+            }
+
+            children.clear();
+            for_each_child(*frame.node, [&children](const AST::Node* child) { children.push_back(child); });
+            work.push_back({frame.node, true, static_cast<uint32_t>(children.size())});
+            for(auto child = children.rbegin(); child != children.rend(); ++child)
+            {
+                work.push_back({*child, false});
+            }
+        }
+    }
+
+    FlatAST::Index FlatAST::add_node(const Node& node)
+    {
+        m_nodes.push_back(node);
+        return static_cast<Index>(m_nodes.size() - 1);
+    }
+
+    FlatAST::Index FlatAST::add_list(const std::span<const Index> items)
+    {
+        const auto offset = static_cast<Index>(m_lists.size());
+        m_lists.push_back(static_cast<Index>(items.size()));
+        m_lists.insert(m_lists.end(), items.begin(), items.end());
+        return offset;
+    }
+
+    FlatAST::Index FlatAST::add_location(const VariableLocation& location)
+    {
+        m_locations.push_back(location);
+        return static_cast<Index>(m_locations.size() - 1);
+    }
+
+    FlatAST::Index FlatAST::add_scope(const ScopeInfo* scope)
+    {
+        if(!scope)
+        {
+            return none;
+        }
+        m_scopes.push_back(scope);
+        return static_cast<Index>(m_scopes.size() - 1);
+    }
+
+    FlatAST::Index FlatAST::emit(const AST::Node& node, const std::span<const Index> children)
+    {
+        const auto kind = node.kind();
+        switch(kind)
+        {
+        case AST::Kind::PROGRAM:
+            return add_node({kind, 0, add_list(children), add_scope(static_cast<const AST::Program&>(node).scope())});
+        case AST::Kind::BLOCK_STATEMENT:
+            return add_node({kind, 0, add_list(children), add_scope(static_cast<const AST::BlockStatement&>(node).scope())});
+        case AST::Kind::FUNCTION_CALL:
+        {
+            const auto& call = static_cast<const AST::FunctionCall&>(node);
+            return add_node({kind, 0, call.name().id(), add_list(children), add_location(call.location())});
+        }
+        case AST::Kind::FUNCTION_DECLARATION:
+            m_functions.push_back(&static_cast<const AST::FunctionDeclaration&>(node));
+            return add_node({kind, 0, static_cast<Index>(m_functions.size() - 1)});
+        case AST::Kind::VARIABLE_DECLARATION:
+        {
+            const auto& declaration = static_cast<const AST::VariableDeclaration&>(node);
+            return add_node({kind, static_cast<uint8_t>(declaration.declaration_kind()), declaration.name().id(), children[0], add_location(declaration.location())});
+        }
+        case AST::Kind::IF_STATEMENT:
+            return add_node({kind, 0, children[0], children[1], children[2]});
+        case AST::Kind::WHILE_STATEMENT:
+        case AST::Kind::FOR_STATEMENT:
+            return add_node({kind, 0, children[0], children[1]});
+        case AST::Kind::RETURN_STATEMENT:
+        case AST::Kind::EXPRESSION_STATEMENT:
+            return add_node({kind, 0, children[0]});
+        case AST::Kind::BINARY_EXPRESSION:
+            return add_node({kind, static_cast<uint8_t>(static_cast<const AST::BinaryExpression&>(node).op()), children[0], children[1]});
+        case AST::Kind::UNARY_EXPRESSION:
+            return add_node({kind, static_cast<uint8_t>(static_cast<const AST::UnaryExpression&>(node).op()), children[0]});
+        case AST::Kind::LITERAL:
+            m_literals.push_back(static_cast<const AST::Literal&>(node).value());
+            return add_node({kind, 0, static_cast<Index>(m_literals.size() - 1)});
+        case AST::Kind::VARIABLE_EXPRESSION:
+        {
+            const auto& variable = static_cast<const AST::VariableExpression&>(node);
+            return add_node({kind, 0, variable.name().id(), none, add_location(variable.location())});
+        }
+        case AST::Kind::VARIABLE_ASSIGNMENT:
+        {
+            const auto& assignment = static_cast<const AST::VariableAssignment&>(node);
+            return add_node({kind, 0, assignment.name().id(), children[0], add_location(assignment.location())});
+        }
+        case AST::Kind::PARAMETER:
+            break;
+        }
+
+        throw std::runtime_error(std::format("Can't flatten a {}", magic_enum::enum_name(kind)));
+    }
+}
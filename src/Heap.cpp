@@ -0,0 +1,142 @@
+#include "Heap.h"
+
+#include <algorithm>
+
+namespace JS
+{
+    thread_local Heap* Heap::m_current = nullptr;
+
+    Cell* Tracer::visit(Cell* cell)
+    {
+        if(m_mode == Mode::MARK)
+        {
+            if(!cell->m_marked)
+            {
+                cell->m_marked = true;
+                m_worklist.push_back(cell);
+            }
+            return cell;
+        }
+
+        if(!m_heap.is_young(cell))
+        {
+            return cell;
+        }
+        if(cell->m_next)
+        {
+            // Already promoted, m_next is the forwarding address
+            return cell->m_next;
+        }
+
+        auto* promoted = cell->promote();
+        m_heap.adopt(promoted, cell->m_size);
+        cell->m_next = promoted;
+        m_worklist.push_back(promoted);
+        return promoted;
+    }
+
+    Heap::Heap()
+        : m_nursery(new std::byte[nursery_size])
+        , m_nursery_top(m_nursery.get())
+        , m_nursery_end(m_nursery.get() + nursery_size)
+    {
+    }
+
+    Heap::~Heap()
+    {
+        for(auto* address = m_nursery.get(); address < m_nursery_top;)
+        {
+            auto* cell = reinterpret_cast<Cell*>(address);
+            address += cell->m_size;
+            cell->~Cell();
+        }
+        while(m_old_cells)
+        {
+            delete std::exchange(m_old_cells, m_old_cells->m_next);
+        }
+    }
+
+    void Heap::adopt(Cell* cell, const size_t size)
+    {
+        cell->m_size = static_cast<uint32_t>(size);
+        cell->m_next = m_old_cells;
+        m_old_cells = cell;
+        m_promoted_since_collection += size;
+        if(m_promoted_since_collection >= m_collection_threshold)
+        {
+            m_collection_requested = true;
+        }
+    }
+
+    void Heap::collect(const std::function<void(Tracer&)>& trace_roots)
+    {
+        // Promoting first leaves the whole heap in the old space for the mark-sweep to look at
+        collect_nursery(trace_roots);
+        if(m_promoted_since_collection >= m_collection_threshold)
+        {
+            collect_old_space(trace_roots);
+        }
+        m_collection_requested = false;
+    }
+
+    void Heap::collect_nursery(const std::function<void(Tracer&)>& trace_roots)
+    {
+        // Cheney's algorithm with the old space as to-space: promote what the roots and the remembered set point
+        // to, then breadth-first whatever the promoted cells point to. The worklist plays the part of the scan
+        // pointer, since the old space isn't contiguous
+        Tracer tracer(*this, Tracer::Mode::EVACUATE);
+        trace_roots(tracer);
+        for(auto* cell : m_remembered_set)
+        {
+            cell->m_remembered = false;
+            cell->visit_edges(tracer);
+        }
+        m_remembered_set.clear();
+        for(size_t scan = 0; scan < tracer.m_worklist.size(); ++scan)
+        {
+            tracer.m_worklist[scan]->visit_edges(tracer);
+        }
+
+        // Young cells own memory of their own (a string's characters, say), so emptying the nursery has to run
+        // their destructors; the promoted ones were moved from
+        for(auto* address = m_nursery.get(); address < m_nursery_top;)
+        {
+            auto* cell = reinterpret_cast<Cell*>(address);
+            address += cell->m_size;
+            cell->~Cell();
+        }
+        m_nursery_top = m_nursery.get();
+    }
+
+    void Heap::collect_old_space(const std::function<void(Tracer&)>& trace_roots)
+    {
+        // Mark with a worklist rather than recursion, a long scope chain or array nesting can't overflow the stack
+        Tracer tracer(*this, Tracer::Mode::MARK);
+        trace_roots(tracer);
+        while(!tracer.m_worklist.empty())
+        {
+            auto* cell = tracer.m_worklist.back();
+            tracer.m_worklist.pop_back();
+            cell->visit_edges(tracer);
+        }
+
+        size_t surviving = 0;
+        for(auto** link = &m_old_cells; *link;)
+        {
+            auto* cell = *link;
+            if(cell->m_marked)
+            {
+                cell->m_marked = false;
+                surviving += cell->m_size;
+                link = &cell->m_next;
+            } else
+            {
+                *link = cell->m_next;
+                delete cell;
+            }
+        }
+
+        m_promoted_since_collection = 0;
+        m_collection_threshold = std::max(minimum_collection_threshold, surviving);
+    }
+}
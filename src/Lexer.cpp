@@ -1,254 +1,711 @@
 #include "Lexer.h"
 
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <algorithm>
-
+#include <array>
+#include <charconv>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <memory>
+
+#include "CharScan.h"
 #include "errors.h"
 #include "Log.h"
+#include "ThreadPool.h"
 
 namespace JS
 {
-    Lexer::Lexer(const std::span<const char> input)
+    Lexer::Lexer(const FileId file_id, const LexerOptions options)
+        : m_file(FileTable::the().file(file_id)), m_file_id(file_id), m_payloads(m_file.payloads), m_options(options)
     {
         m_index = 0;
-        m_input = input;
-
-        m_keywords = {
-            {"function", TokenType::FUNCTION},
-            {"if", TokenType::IF},
-            {"let", TokenType::LET},
-            {"const", TokenType::CONST},
-            {"var", TokenType::VAR},
-            {"return", TokenType::RETURN},
-            {"for", TokenType::FOR},
-            {"while", TokenType::WHILE},
-            {"continue", TokenType::CONTINUE},
-            {"break", TokenType::BREAK},
-        };
-
-        m_three_character_symbols = {
-            {"===", TokenType::EQUAL_EQUAL_EQUAL},
-            {"!==", TokenType::NOT_EQUAL_EQUAL},
-        };
+        m_input = m_file.source;
+    }
 
-        m_two_character_symbols = {
-            {"+=", TokenType::PLUS_EQUALS},
-            {"-=", TokenType::MINUS_EQUALS},
-            {"*=", TokenType::MULT_EQUALS},
-            {"/=", TokenType::DIV_EQUALS},
-            {"++", TokenType::INCREMENT},
-            {"--", TokenType::DECREMENT},
-            {"%=", TokenType::MOD_EQUALS},
-            {"|=", TokenType::OR_EQUALS},
-            {"&=", TokenType::AND_EQUALS},
-            {"^=", TokenType::MOD_EQUALS},
-            {">>", TokenType::SHIFT_RIGHT},
-            {"<<", TokenType::SHIFT_LEFT},
-            {"=>", TokenType::ARROW},
-        };
+    Lexer::Lexer(const FileId file_id, const size_t start, const size_t end)
+        : m_file(FileTable::the().file(file_id)), m_file_id(file_id), m_payloads(m_file.payloads)
+    {
+        m_index = start;
+        m_input = m_file.source.first(end);
+    }
 
-        // TODO: handle negative numbers
-        m_one_character_symbols = {
-            {"+", TokenType::PLUS},
-            {"-", TokenType::MINUS},
-            {"/", TokenType::DIV},
-            {"*", TokenType::MULT},
-            {"(", TokenType::LEFT_PAREN},
-            {")", TokenType::RIGHT_PAREN},
-            {"[", TokenType::LEFT_SQUARE_BRACKET},
-            {"]", TokenType::RIGHT_SQUARE_BRACKET},
-            {"{", TokenType::LEFT_CURLY_BRACE},
-            {"}", TokenType::RIGHT_CURLY_BRACE},
-            {"%", TokenType::MOD},
-            {"^", TokenType::XOR},
-            {"&", TokenType::AND},
-            {".", TokenType::PERIOD},
-            {",", TokenType::COMMA},
-            {"=", TokenType::EQUALS},
-            {";", TokenType::SEMICOLON},
-            {":", TokenType::COLON},
-        };
+    Lexer::Lexer(const FileId file_id, const size_t start, const size_t limit, TokenPayloads& payloads, SpeculativeNames& names)
+        : m_file(FileTable::the().file(file_id)), m_file_id(file_id), m_payloads(payloads), m_speculative(true), m_speculative_names(&names)
+    {
+        m_index = start;
+        m_input = m_file.source.first(limit);
     }
 
     Token Lexer::next()
     {
+        skip_trivia();
+
         if (m_index >= m_input.size())
         {
-            return {TokenType::END_OF_FILE, span_from_here()};
+            return make_token(TokenType::END_OF_FILE, m_index);
         }
-        if (std::isspace(peek()))
+
+        const size_t start = m_index;
+
+        // Dispatch on the first byte, every case is decided without scanning a list of candidates
+        switch (TokenTable::classify(peek()))
         {
-            if (peek() == '\n') // FIXME: handle carriage return
+        case TokenTable::CharClass::WHITESPACE:
+            // Unreachable, skip_trivia() stops on the first non-whitespace byte
+            break;
+        case TokenTable::CharClass::QUOTE:
+            return lex_string();
+        case TokenTable::CharClass::PUNCTUATOR:
+            if (peek() == '.' && m_index + 1 < m_input.size() && TokenTable::classify(peek(1)) == TokenTable::CharClass::DIGIT)
             {
-                ++m_line_number;
-                m_col = 0;
+                return lex_number(); // .5
             }
-            else
+            for (const auto& bucket = TokenTable::punctuator_buckets[static_cast<unsigned char>(peek())];
+                 const auto index : std::span{bucket.indices.data(), bucket.count})
             {
-                ++m_col;
+                const auto& [token_type, symbol] = TokenTable::punctuators[index];
+                if (matches(symbol))
+                {
+                    consume(symbol.size());
+                    return make_token(token_type, start);
+                }
             }
+            break;
+        case TokenTable::CharClass::IDENTIFIER_START:
+            {
+                // Consume identifier, then check whether it is actually a keyword
+                m_index = CharScan::skip_identifier(m_input.data() + m_index, m_input.data() + m_input.size()) - m_input.data();
+                const std::string_view word{m_input.data() + start, m_index - start};
+
+                const auto token_type = TokenTable::keyword_or_identifier(word);
+                if (token_type == TokenType::IDENTIFIER && m_speculative_names)
+                {
+                    const auto [id, inserted] = m_speculative_names->ids.try_emplace(word, static_cast<uint32_t>(m_speculative_names->names.size()));
+                    if (inserted)
+                    {
+                        m_speculative_names->names.push_back(word);
+                    }
+                    return make_token(token_type, start, id->second);
+                }
+                if (token_type == TokenType::IDENTIFIER)
+                {
+                    return make_token(token_type, start, AtomTable::the().intern(word).id());
+                }
+                return make_token(token_type, start);
+            }
+        case TokenTable::CharClass::DIGIT:
+            return lex_number();
+        case TokenTable::CharClass::INVALID:
+            break;
+        }
+
+        report_error("Unknown character");
+        consume();
+        return make_token(TokenType::INVALID, start);
+    }
+
+
+    Token Lexer::lex_string()
+    {
+        const size_t start = m_index;
+        const char quote = consume();
+        const auto token_type = quote == '"' ? TokenType::DOUBLE_QUOTED_STRING : TokenType::SINGLE_QUOTED_STRING;
+
+        // Fast path: no escapes, so the payload is just a view of the source
+        const size_t body_start = m_index;
+        const char* const input_end = m_input.data() + m_input.size();
+        m_index = CharScan::find_string_stop(m_input.data() + m_index, input_end, quote) - m_input.data();
+
+        if (m_index >= m_input.size() || peek() != '\\')
+        {
+            const auto body_length = static_cast<uint32_t>(m_index - body_start);
+            consume_closing_quote(quote);
+            return make_token(token_type, start, body_length);
+        }
+
+        // Slow path: decode into the side buffer
+        std::string cooked{m_input.data() + body_start, m_index - body_start};
+        while (m_index < m_input.size() && peek() == '\\')
+        {
+            consume(); // Consume backslash
+            append_escape_sequence(cooked);
+
+            // Copy the next escape-free run in one go
+            const size_t run_start = m_index;
+            m_index = CharScan::find_string_stop(m_input.data() + m_index, input_end, quote) - m_input.data();
+            cooked.append(m_input.data() + run_start, m_index - run_start);
+        }
+
+        consume_closing_quote(quote);
+
+        m_payloads.cooked_strings.push_back(std::move(cooked));
+        return make_token(token_type, start, static_cast<uint32_t>(m_payloads.cooked_strings.size() - 1), Token::COOKED_STRING);
+    }
+
+    void Lexer::consume_closing_quote(const char quote)
+    {
+        if (m_index < m_input.size() && peek() == quote)
+        {
             consume();
-            return {TokenType::WHITESPACE, span_from_here()};
+            return;
+        }
+
+        // A line break or the end of the input. The string ends here, so lexing picks up again on the next line
+        report_error("Unterminated string literal");
+    }
+
+    void Lexer::append_escape_sequence(std::string& cooked)
+    {
+        if (m_index >= m_input.size())
+        {
+            return;
         }
 
-        switch (peek())
+        const auto read_hex = [&](const size_t digits) -> uint32_t
+        {
+            uint32_t value = 0;
+            for (size_t i = 0; i < digits; ++i)
+            {
+                if (m_index >= m_input.size() || !std::isxdigit(static_cast<unsigned char>(peek())))
+                {
+                    report_error("Invalid hexadecimal escape sequence");
+                    throw InvalidSyntax{};
+                }
+                const char c = static_cast<char>(std::tolower(static_cast<unsigned char>(consume())));
+                value = value * 16 + (c <= '9' ? c - '0' : c - 'a' + 10);
+            }
+            return value;
+        };
+
+        switch (const char c = consume())
         {
-        case '"':
+        case 'n': cooked += '\n'; break;
+        case 't': cooked += '\t'; break;
+        case 'r': cooked += '\r'; break;
+        case 'b': cooked += '\b'; break;
+        case 'f': cooked += '\f'; break;
+        case 'v': cooked += '\v'; break;
+        case '0': cooked += '\0'; break;
+        case '\n': break; // Line continuation
+        case '\r':
+            if (m_index < m_input.size() && peek() == '\n')
             {
                 consume();
-                // Consume double quoted string
-                auto string_span = consume_until('"');
-                consume(); // Consume trailing quote
-                std::string string{string_span.data(), string_span.size()};
-                return {TokenType::DOUBLE_QUOTED_STRING, string, span_from_here(string.size() + 1)};
             }
             break;
-        case '\'':
+        case 'x': cooked += static_cast<char>(read_hex(2)); break;
+        case 'u':
             {
-                // Consume single quoted string
-                consume();
-                // Consume double quoted string
-                auto string_span = consume_until('\'');
-                consume(); // Consume trailing quote
-                std::string string{string_span.data(), string_span.size()};
-                return {TokenType::SINGLE_QUOTED_STRING, string, span_from_here(string.size() + 1)};
+                // Encode the BMP code point as UTF-8
+                const uint32_t code_point = read_hex(4);
+                if (code_point < 0x80)
+                {
+                    cooked += static_cast<char>(code_point);
+                }
+                else if (code_point < 0x800)
+                {
+                    cooked += static_cast<char>(0xC0 | (code_point >> 6));
+                    cooked += static_cast<char>(0x80 | (code_point & 0x3F));
+                }
+                else
+                {
+                    cooked += static_cast<char>(0xE0 | (code_point >> 12));
+                    cooked += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                    cooked += static_cast<char>(0x80 | (code_point & 0x3F));
+                }
             }
+            break;
         default:
+            // \\, \', \" and any unknown escape stand for the character itself
+            cooked += c;
             break;
         }
+    }
 
-        // Progressively narrow matches
+    namespace
+    {
+        constexpr unsigned digit_value(const char c)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'z')
+            {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'Z')
+            {
+                return c - 'A' + 10;
+            }
+            return 36;
+        }
 
-        for (const auto& [keyword, token_type] : m_keywords)
+        // Whether a decimal literal that from_chars rejected as out of range is too big (rather than too small)
+        bool overflows(const std::string_view digits)
         {
-            // Handle cases where identifier starts with keyword
-            if (matches(keyword) && !std::isalpha(peek(keyword.size())))
+            const size_t exponent_start = digits.find_first_of("eE");
+            const auto significand = digits.substr(0, exponent_start);
+            long long exponent = 0;
+            if (exponent_start != std::string_view::npos)
+            {
+                std::from_chars(digits.data() + exponent_start + 1 + (digits[exponent_start + 1] == '+'),
+                                digits.data() + digits.size(), exponent);
+            }
+
+            // Decimal magnitude of the leading significant digit
+            const size_t point = std::min(significand.find('.'), significand.size());
+            const size_t first_significant = significand.find_first_not_of("0.");
+            if (first_significant == std::string_view::npos)
             {
-                // Insert keyword token
-                consume(keyword.size());
-                return {token_type, span_from_here(keyword.size())};
+                return false;
             }
+            const auto magnitude = first_significant < point
+                ? static_cast<long long>(point - first_significant)
+                : -static_cast<long long>(first_significant - point - 1);
+            return magnitude + exponent > 0;
         }
+    }
 
-        for (const auto& [symbol, token_type] : m_three_character_symbols)
+    size_t Lexer::consume_digits(const unsigned radix, bool& has_separators)
+    {
+        size_t digits = 0;
+        while (m_index < m_input.size())
         {
-            if (matches(symbol))
+            if (peek() == '_')
             {
-                // Insert keyword token
-                consume(symbol.size());
-                return {token_type, span_from_here(3)};
+                // Separators may only sit between two digits
+                if (digits == 0 || m_index + 1 >= m_input.size() || digit_value(peek(1)) >= radix)
+                {
+                    number_error("Misplaced numeric separator");
+                }
+                has_separators = true;
+                ++m_index;
+                continue;
+            }
+
+            if (digit_value(peek()) >= radix)
+            {
+                break;
             }
+            ++digits;
+            ++m_index;
         }
+        return digits;
+    }
+
+    void Lexer::number_error(const char* message) const
+    {
+        report_error(message);
+        throw InvalidSyntax{};
+    }
+
+    void Lexer::report_error(const char* message) const
+    {
+        if (m_speculative)
+        {
+            // The chunk may have started inside a string or comment, so this isn't necessarily an error. Give up
+            // and let lex_parallel() redo this stretch from a known token boundary
+            throw InvalidSyntax{};
+        }
+        m_reported_errors = true;
+        Log::the().error(message, " at ", make_token(TokenType::INVALID, m_index).span().to_string());
+    }
+
+    Token Lexer::lex_number()
+    {
+        const size_t start = m_index;
+        bool has_separators = false;
 
-        for (const auto& [symbol, token_type] : m_two_character_symbols)
+        const auto finish = [&]
         {
-            if (matches(symbol))
+            // 3in and 3.toString are errors, a numeric literal can't run straight into an identifier or digit
+            if (m_index < m_input.size() && TokenTable::is_identifier_part(peek()))
             {
-                // Insert keyword token
-                consume(symbol.size());
-                return {token_type, span_from_here(2)};
+                number_error("Identifier starts immediately after numeric literal");
+            }
+        };
+
+        // 0x, 0o and 0b literals
+        if (peek() == '0' && m_index + 1 < m_input.size())
+        {
+            const auto prefix = static_cast<char>(std::tolower(static_cast<unsigned char>(peek(1))));
+            const unsigned radix = prefix == 'x' ? 16 : prefix == 'o' ? 8 : prefix == 'b' ? 2 : 0;
+            if (radix != 0)
+            {
+                consume(2);
+                const size_t digits_start = m_index;
+                if (consume_digits(radix, has_separators) == 0)
+                {
+                    number_error("Expected digits after radix prefix");
+                }
+                finish();
+
+                // Exact in 64 bits, and correctly rounded through a double past that
+                uint64_t value = 0;
+                double large_value = 0;
+                bool is_large = false;
+                for (const char c : std::string_view{m_input.data() + digits_start, m_index - digits_start})
+                {
+                    if (c == '_')
+                    {
+                        continue;
+                    }
+                    const unsigned digit = digit_value(c);
+                    if (!is_large && value > (UINT64_MAX - digit) / radix)
+                    {
+                        is_large = true;
+                        large_value = static_cast<double>(value);
+                    }
+                    if (is_large)
+                    {
+                        large_value = large_value * radix + digit;
+                    }
+                    else
+                    {
+                        value = value * radix + digit;
+                    }
+                }
+
+                if (!is_large && value <= UINT32_MAX)
+                {
+                    return make_token(TokenType::NUMBER, start, static_cast<uint32_t>(value), Token::SMALL_INTEGER);
+                }
+                m_payloads.numbers.push_back(is_large ? large_value : static_cast<double>(value));
+                return make_token(TokenType::NUMBER, start, static_cast<uint32_t>(m_payloads.numbers.size() - 1));
             }
         }
 
-        for (const auto& [symbol, token_type] : m_one_character_symbols)
+        // Decimal: digits, optional fraction, optional exponent. Either side of the point may be empty, not both
+        const size_t integer_digits = consume_digits(10, has_separators);
+        bool is_integer = true;
+        if (m_index < m_input.size() && peek() == '.')
+        {
+            consume();
+            if (m_index < m_input.size() && peek() == '_')
+            {
+                number_error("Misplaced numeric separator");
+            }
+            consume_digits(10, has_separators);
+            is_integer = false;
+        }
+        if (m_index < m_input.size() && (peek() == 'e' || peek() == 'E'))
         {
-            if (matches(symbol))
+            consume();
+            if (m_index < m_input.size() && (peek() == '+' || peek() == '-'))
             {
-                // Insert keyword token
                 consume();
-                return {token_type, span_from_here(1)};
             }
+            if (consume_digits(10, has_separators) == 0)
+            {
+                number_error("Expected digits in exponent");
+            }
+            is_integer = false;
         }
+        finish();
+
+        const std::string_view text{m_input.data() + start, m_index - start};
 
-        if (std::isalpha(peek()))
+        // Fast path: small integers go straight into the token and never touch a double
+        if (is_integer && integer_digits <= 9)
         {
-            // Consume identifier
-            auto str_span = consume_while([](const char c)
+            uint32_t value = 0;
+            for (const char c : text)
             {
-                return std::isalnum(c);
-            });
-
-            std::string str{str_span.data(), str_span.size()};
-            // Parse string against keywords
-            return {TokenType::IDENTIFIER, str, span_from_here(str.size())};
+                if (c != '_')
+                {
+                    value = value * 10 + (c - '0');
+                }
+            }
+            return make_token(TokenType::NUMBER, start, value, Token::SMALL_INTEGER);
         }
 
-        if (std::isdigit(peek()))
+        // from_chars doesn't understand separators, strip them into a stack buffer (or the heap for absurd literals)
+        std::array<char, 128> stack_buffer{};
+        std::string heap_buffer;
+        std::string_view digits = text;
+        if (has_separators)
         {
-            // Consume number
-            bool has_seen_period = false;
-            auto num_span = consume_while([&](const char c)
+            char* out = stack_buffer.data();
+            if (text.size() > stack_buffer.size())
+            {
+                heap_buffer.resize(text.size());
+                out = heap_buffer.data();
+            }
+            const char* const out_start = out;
+            for (const char c : text)
             {
-                if (c == '.')
+                if (c != '_')
                 {
-                    if (has_seen_period)
-                    {
-                        throw InvalidSyntax{};
-                    }
-                    has_seen_period = true;
-                    return true;
+                    *out++ = c;
                 }
-                return std::isdigit(c) != 0;
-            });
+            }
+            digits = {out_start, static_cast<size_t>(out - out_start)};
+        }
 
-            const std::string num_string{num_span.data(), num_span.size()};
-            const double num = std::stod(num_string);
-            return {TokenType::NUMBER, num, span_from_here(num_string.size())};
+        double value = 0;
+        if (const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+            error == std::errc::result_out_of_range)
+        {
+            value = overflows(digits) ? std::numeric_limits<double>::infinity() : 0.0;
+        }
+        else if (error != std::errc{} || end != digits.data() + digits.size())
+        {
+            number_error("Malformed numeric literal");
         }
 
-        Log::the().error("Unknown character: ", consume());
-        return {TokenType::INVALID, span_from_here()};
+        m_payloads.numbers.push_back(value);
+        return make_token(TokenType::NUMBER, start, static_cast<uint32_t>(m_payloads.numbers.size() - 1));
     }
 
+    void Lexer::skip_trivia()
+    {
+        const char* const input_end = m_input.data() + m_input.size();
+        while (true)
+        {
+            m_index = CharScan::skip_whitespace(m_input.data() + m_index, input_end) - m_input.data();
+
+            if (matches("//"))
+            {
+                const auto* newline = static_cast<const char*>(std::memchr(m_input.data() + m_index, '\n', m_input.size() - m_index));
+                m_index = newline ? newline - m_input.data() : m_input.size();
+            }
+            else if (matches("/*"))
+            {
+                const std::string_view rest{m_input.data() + m_index + 2, m_input.size() - m_index - 2};
+                const auto close = rest.find("*/");
+                if (close == std::string_view::npos)
+                {
+                    report_error("Unterminated block comment");
+                    m_index = m_input.size();
+                }
+                else
+                {
+                    m_index += close + 4;
+                }
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
 
-    std::vector<Token> Lexer::lex(const std::string& file_name)
+    std::vector<Token> Lexer::lex()
     {
-        m_filename = file_name;
-        m_line_number = 0;
-        m_col = 0;
+        if (lexes_in_parallel())
+        {
+            return lex_parallel();
+        }
 
         // TODO: automatic semicolon insertion
-        std::vector skipped_types{
-            TokenType::INVALID, TokenType::WHITESPACE
-        };
-
         std::vector<Token> ret;
+        lex_until(m_input.size(), ret);
+        ret.push_back(next()); // END_OF_FILE
+        return ret;
+    }
+
+    bool Lexer::lexes_in_parallel() const
+    {
+        return m_input.size() - m_index >= m_options.parallel_threshold && ThreadPool::the().thread_count() > 1;
+    }
+
+    void Lexer::lex_until(const size_t stop, std::vector<Token>& tokens)
+    {
+        // Every token that starts before stop; the last one may run past it
         while (true)
         {
-            auto tok = next();
-            if (std::find(skipped_types.begin(), skipped_types.end(), tok.type) != skipped_types.end())
+            skip_trivia();
+            if (m_index >= stop || m_index >= m_input.size())
             {
-                // Skip
+                return;
+            }
+
+            if (auto token = next(); token.type != TokenType::INVALID)
+            {
+                tokens.push_back(token);
+            }
+        }
+    }
+
+    std::vector<Token> Lexer::lex_parallel()
+    {
+        struct Chunk
+        {
+            size_t start;
+            size_t stop;
+            std::vector<Token> tokens;
+            TokenPayloads payloads;
+            SpeculativeNames names;
+            // Where the next token after this chunk starts, if the chunk was lexed from a real token boundary
+            size_t resume{0};
+            bool failed{false};
+        };
+
+        // Nominal boundaries every chunk_size bytes, pushed to the start of the next line. Only block comments and
+        // strings with a line continuation span lines, so that usually lands between tokens and the chunk is kept.
+        // When it doesn't, the stitching below finds the chunk out of sync and lexes that stretch again
+        const char* const data = m_input.data();
+        const size_t size = m_input.size();
+        std::vector boundaries{m_index};
+        for (size_t nominal = m_index + m_options.chunk_size; nominal < size; nominal += m_options.chunk_size)
+        {
+            const auto* newline = static_cast<const char*>(std::memchr(data + nominal, '\n', std::min(m_options.chunk_size, size - nominal)));
+            const size_t boundary = newline ? newline - data + 1 : nominal;
+            if (boundary > boundaries.back() && boundary < size)
+            {
+                boundaries.push_back(boundary);
+            }
+        }
+        boundaries.push_back(size);
+
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        std::vector<std::future<void>> done;
+        for (size_t i = 0; i + 1 < boundaries.size(); ++i)
+        {
+            auto& chunk = chunks.emplace_back(std::make_unique<Chunk>(boundaries[i], boundaries[i + 1]));
+            done.push_back(ThreadPool::the().submit([this, &chunk = *chunk]
+            {
+                // A token running more than a chunk past its boundary means we probably started inside a string
+                // or comment; the limit turns that into a cheap failure instead of a scan to the end of the file
+                const size_t limit = std::min(m_input.size(), chunk.stop + m_options.chunk_size);
+                Lexer lexer(m_file_id, chunk.start, limit, chunk.payloads, chunk.names);
+                try
+                {
+                    lexer.lex_until(chunk.stop, chunk.tokens);
+                    chunk.resume = lexer.m_index;
+                    chunk.failed = lexer.m_index >= limit && limit < m_input.size();
+                }
+                catch (const InvalidSyntax&)
+                {
+                    chunk.failed = true;
+                }
+            }));
+        }
+
+        // Stitch in order. expected is the offset of the next real token; a chunk that has a token starting exactly
+        // there is in sync from that token on, because the lexer carries no state between tokens. Otherwise its
+        // speculative start was inside a token and the chunk is lexed again from expected
+        std::vector<Token> tokens;
+        size_t expected = m_index;
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            done[i].get();
+            auto& chunk = *chunks[i];
+            if (expected >= chunk.stop)
+            {
+                // The previous chunk's last token swallowed this one whole
                 continue;
             }
-            ret.push_back(tok);
-            if (tok.type == TokenType::END_OF_FILE)
+
+            const auto first = std::lower_bound(chunk.tokens.begin(), chunk.tokens.end(), expected,
+                                                [](const Token& token, const size_t offset) { return token.offset < offset; });
+            if (chunk.failed || first == chunk.tokens.end() || first->offset != expected)
             {
-                break;
+                m_index = expected;
+                lex_until(chunk.stop, tokens);
+                expected = m_index;
+                continue;
             }
+
+            // Move the chunk's payloads into the file's tables and rebase the indices that refer to them
+            const auto number_base = static_cast<uint32_t>(m_payloads.numbers.size());
+            const auto cooked_base = static_cast<uint32_t>(m_payloads.cooked_strings.size());
+            m_payloads.numbers.insert(m_payloads.numbers.end(), chunk.payloads.numbers.begin(), chunk.payloads.numbers.end());
+            std::move(chunk.payloads.cooked_strings.begin(), chunk.payloads.cooked_strings.end(), std::back_inserter(m_payloads.cooked_strings));
+
+            // Intern the names the kept tokens use; atom 0 is the empty string, which no identifier is
+            std::vector<uint32_t> atom_ids(chunk.names.names.size(), 0);
+            for (auto token = first; token != chunk.tokens.end(); ++token)
+            {
+                if (token->type == TokenType::IDENTIFIER)
+                {
+                    auto& atom_id = atom_ids[token->payload];
+                    if (atom_id == 0)
+                    {
+                        atom_id = AtomTable::the().intern(chunk.names.names[token->payload]).id();
+                    }
+                    token->payload = atom_id;
+                }
+                else if (token->type == TokenType::NUMBER && !(token->flags & Token::SMALL_INTEGER))
+                {
+                    token->payload += number_base;
+                }
+                else if (token->flags & Token::COOKED_STRING)
+                {
+                    token->payload += cooked_base;
+                }
+            }
+            tokens.insert(tokens.end(), first, chunk.tokens.end());
+            expected = chunk.resume;
+
+            // Free each chunk as soon as it's merged
+            chunk.tokens = {};
+            chunk.payloads = {};
+            chunk.names = {};
         }
 
-        return ret;
+        m_index = expected;
+        tokens.push_back(next()); // END_OF_FILE
+        return tokens;
     }
 
-    std::span<const char> Lexer::consume_until(const char stop)
+    std::vector<Token> Lexer::relex(const FileId file_id, const std::span<const Token> previous, const TextEdit& edit)
     {
-        size_t len = 0;
+        // Tokens ending strictly before the edit are untouched: a token that ends right at it could be extended by
+        // the inserted text, but nothing the lexer does looks at the byte after a token and beyond
+        const auto kept_end = std::partition_point(previous.begin(), previous.end(), [&](const Token& token)
+        {
+            return token.type != TokenType::END_OF_FILE && token.offset + token.length < edit.start;
+        });
+        std::vector<Token> tokens(previous.begin(), kept_end);
+
+        Lexer lexer(file_id);
+        lexer.m_index = tokens.empty() ? 0 : tokens.back().offset + tokens.back().length;
+
+        // Old tokens starting after the removed text are candidates for reuse. Once the new stream has a token
+        // starting where one of them would land, the rest of the old stream is valid again: the text from there on
+        // is the same, and the lexer carries no state from one token to the next
+        const int64_t delta = edit.delta();
+        const uint32_t new_damage_end = edit.start + edit.inserted_length;
+        auto old = std::partition_point(kept_end, previous.end(), [&](const Token& token)
+        {
+            return token.offset < edit.start + edit.removed_length;
+        });
 
         while (true)
         {
-            if (peek(len) == stop)
+            lexer.skip_trivia();
+            if (const auto position = static_cast<int64_t>(lexer.m_index); position >= new_damage_end)
             {
-                break;
+                while (old != previous.end() && old->offset + delta < position)
+                {
+                    ++old;
+                }
+                if (old != previous.end() && old->offset + delta == position)
+                {
+                    for (; old != previous.end(); ++old)
+                    {
+                        auto& token = tokens.emplace_back(*old);
+                        token.offset = static_cast<uint32_t>(token.offset + delta);
+                    }
+                    return tokens;
+                }
             }
 
-            ++len;
+            const auto token = lexer.next();
+            if (token.type != TokenType::INVALID)
+            {
+                tokens.push_back(token);
+            }
+            if (token.type == TokenType::END_OF_FILE)
+            {
+                return tokens;
+            }
         }
-
-        const std::span<const char> span{m_input.begin() + static_cast<long long>(m_index), len};
-        m_index += len;
-        return span;
     }
 
     std::span<const char> Lexer::consume(const size_t n)
@@ -263,31 +720,26 @@ namespace JS
         return m_input[m_index++];
     }
 
-    Span Lexer::span_from_here(const size_t num_characters_back) const
+    Token Lexer::make_token(const TokenType type, const size_t start, const uint32_t payload, const uint8_t flags) const
     {
-        // FIXME: This is tricky because be need to underflow col on a multiline string for example
-        // Also theres a bug where they underflow on the first col
-        // Thus, col numbers currently overflow, lol
         return {
-            m_filename,
-            {m_line_number, m_col - num_characters_back, m_index - num_characters_back},
-            {m_line_number, m_col, m_index}
+            type,
+            flags,
+            m_file_id,
+            static_cast<uint32_t>(start),
+            static_cast<uint32_t>(m_index - start),
+            payload
         };
     }
 
-    void Lexer::rewind(const size_t off)
-    {
-        m_index -= off;
-    }
-
     char Lexer::peek(const size_t off) const
     {
         return m_input[m_index + off];
     }
 
-    bool Lexer::matches(const std::string& pattern) const
+    bool Lexer::matches(const std::string_view pattern) const
     {
-        if (m_index + pattern.size() >= m_input.size())
+        if (m_index + pattern.size() > m_input.size())
         {
             return false;
         }
@@ -304,24 +756,4 @@ namespace JS
 
         return true;
     }
-
-    template <typename P>
-    std::span<const char> Lexer::consume_while(P predicate)
-    {
-        size_t len = 0;
-
-        while (true)
-        {
-            if (!predicate(peek(len)))
-            {
-                break;
-            }
-
-            ++len;
-        }
-
-        const std::span span{m_input.begin() + static_cast<long long>(m_index), len};
-        m_index += len;
-        return span;
-    }
 }
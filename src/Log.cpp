@@ -1,3 +0,0 @@
-#include "Log.h"
-
-Log* Log::m_the = nullptr;
\ No newline at end of file
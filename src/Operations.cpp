@@ -0,0 +1,586 @@
+#include "Operations.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+namespace JS::Operations
+{
+    namespace
+    {
+        using Type = Value::Type;
+
+        bool is_primitive(const Value& value)
+        {
+            switch(value.type())
+            {
+            case Type::NUMBER:
+            case Type::BOOLEAN:
+            case Type::STRING:
+            case Type::UNDEFINED:
+            case Type::NIL:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // Whitespace and line terminators other than ASCII ones, UTF-8 encoded: NBSP, the Zs space separators,
+        // LS, PS and the BOM
+        constexpr std::array<std::string_view, 19> unicode_whitespace = {
+            "\xC2\xA0", "\xE1\x9A\x80", "\xE2\x80\x80", "\xE2\x80\x81", "\xE2\x80\x82", "\xE2\x80\x83", "\xE2\x80\x84",
+            "\xE2\x80\x85", "\xE2\x80\x86", "\xE2\x80\x87", "\xE2\x80\x88", "\xE2\x80\x89", "\xE2\x80\x8A",
+            "\xE2\x80\xA8", "\xE2\x80\xA9", "\xE2\x80\xAF", "\xE2\x81\x9F", "\xE3\x80\x80", "\xEF\xBB\xBF"
+        };
+
+        size_t leading_whitespace(const std::string_view string)
+        {
+            const auto c = string.front();
+            if(c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f')
+            {
+                return 1;
+            }
+
+            for(const auto space : unicode_whitespace)
+            {
+                if(string.starts_with(space))
+                {
+                    return space.size();
+                }
+            }
+            return 0;
+        }
+
+        size_t trailing_whitespace(const std::string_view string)
+        {
+            const auto c = string.back();
+            if(c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f')
+            {
+                return 1;
+            }
+
+            for(const auto space : unicode_whitespace)
+            {
+                if(string.ends_with(space))
+                {
+                    return space.size();
+                }
+            }
+            return 0;
+        }
+
+        std::string_view trim(std::string_view string)
+        {
+            while(!string.empty())
+            {
+                const auto length = leading_whitespace(string);
+                if(length == 0)
+                {
+                    break;
+                }
+                string.remove_prefix(length);
+            }
+            while(!string.empty())
+            {
+                const auto length = trailing_whitespace(string);
+                if(length == 0)
+                {
+                    break;
+                }
+                string.remove_suffix(length);
+            }
+
+            return string;
+        }
+
+        // 0x, 0o and 0b literals. Every digit is turned into hex so from_chars can round the value correctly
+        // however many digits there are
+        double radix_integer(const std::string_view digits, const unsigned bits_per_digit)
+        {
+            const auto digit_value = [](const char c) -> int
+            {
+                if(c >= '0' && c <= '9') return c - '0';
+                if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+                if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+                return 16;
+            };
+
+            if(digits.empty())
+            {
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+
+            std::string hex;
+            if(bits_per_digit == 4)
+            {
+                if(!std::ranges::all_of(digits, [&](const char c) { return digit_value(c) < 16; }))
+                {
+                    return std::numeric_limits<double>::quiet_NaN();
+                }
+                hex = digits;
+            } else
+            {
+                std::string bits;
+                for(const auto c : digits)
+                {
+                    const auto value = digit_value(c);
+                    if(value >= (1 << bits_per_digit))
+                    {
+                        return std::numeric_limits<double>::quiet_NaN();
+                    }
+                    for(int bit = static_cast<int>(bits_per_digit) - 1; bit >= 0; --bit)
+                    {
+                        bits.push_back((value >> bit) & 1 ? '1' : '0');
+                    }
+                }
+
+                bits.insert(0, (4 - bits.size() % 4) % 4, '0');
+                for(size_t i = 0; i < bits.size(); i += 4)
+                {
+                    const auto nibble = (bits[i] - '0') << 3 | (bits[i + 1] - '0') << 2 | (bits[i + 2] - '0') << 1 | (bits[i + 3] - '0');
+                    hex.push_back("0123456789abcdef"[nibble]);
+                }
+            }
+
+            double result = 0;
+            const auto [end, error] = std::from_chars(hex.data(), hex.data() + hex.size(), result, std::chars_format::hex);
+            if(error == std::errc::result_out_of_range)
+            {
+                return std::numeric_limits<double>::infinity();
+            }
+            return result;
+        }
+
+        // StrUnsignedDecimalLiteral without Infinity: digits, an optional fraction and an optional exponent
+        bool is_unsigned_decimal(const std::string_view string)
+        {
+            size_t i = 0;
+            size_t digits = 0;
+            while(i < string.size() && std::isdigit(static_cast<unsigned char>(string[i])))
+            {
+                ++i;
+                ++digits;
+            }
+            if(i < string.size() && string[i] == '.')
+            {
+                ++i;
+                while(i < string.size() && std::isdigit(static_cast<unsigned char>(string[i])))
+                {
+                    ++i;
+                    ++digits;
+                }
+            }
+            if(digits == 0)
+            {
+                return false;
+            }
+            if(i < string.size() && (string[i] == 'e' || string[i] == 'E'))
+            {
+                ++i;
+                if(i < string.size() && (string[i] == '+' || string[i] == '-'))
+                {
+                    ++i;
+                }
+                const auto exponent_start = i;
+                while(i < string.size() && std::isdigit(static_cast<unsigned char>(string[i])))
+                {
+                    ++i;
+                }
+                if(i == exponent_start)
+                {
+                    return false;
+                }
+            }
+
+            return i == string.size();
+        }
+
+        // The string as UTF-16 code units; bytes that aren't valid UTF-8 become U+FFFD
+        std::u16string to_utf16(const std::string_view string)
+        {
+            std::u16string units;
+            units.reserve(string.size());
+            for(size_t i = 0; i < string.size();)
+            {
+                const auto lead = static_cast<unsigned char>(string[i]);
+                const size_t length = lead < 0x80 ? 1 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+                char32_t code_point = length == 1 ? lead : length == 2 ? lead & 0x1F : length == 3 ? lead & 0x0F : lead & 0x07;
+                bool valid = length > 0 && i + length <= string.size();
+                for(size_t j = 1; valid && j < length; ++j)
+                {
+                    const auto continuation = static_cast<unsigned char>(string[i + j]);
+                    valid = (continuation & 0xC0) == 0x80;
+                    code_point = code_point << 6 | (continuation & 0x3F);
+                }
+                if(!valid || code_point > 0x10FFFF)
+                {
+                    units.push_back(u'\uFFFD');
+                    ++i;
+                    continue;
+                }
+
+                if(code_point >= 0x10000)
+                {
+                    units.push_back(static_cast<char16_t>(0xD800 + ((code_point - 0x10000) >> 10)));
+                    units.push_back(static_cast<char16_t>(0xDC00 + ((code_point - 0x10000) & 0x3FF)));
+                } else
+                {
+                    units.push_back(static_cast<char16_t>(code_point));
+                }
+                i += length;
+            }
+
+            return units;
+        }
+
+        // Strings compare by UTF-16 code units. UTF-8 byte order agrees with that except between a supplementary
+        // character and one in U+E000..U+FFFF, and both of those have lead bytes of 0xEE and up
+        bool string_less_than(const std::string_view left, const std::string_view right)
+        {
+            const auto below_ee = [](const std::string_view string)
+            {
+                return std::ranges::none_of(string, [](const char c) { return static_cast<unsigned char>(c) >= 0xEE; });
+            };
+            if(below_ee(left) || below_ee(right))
+            {
+                return left < right;
+            }
+
+            return to_utf16(left) < to_utf16(right);
+        }
+
+        // IsLessThan's answers
+        enum class LessThan
+        {
+            LESS,
+            NOT_LESS,
+            // A NaN was involved, which makes every relational operator false
+            UNDEFINED
+        };
+
+        LessThan is_less_than(const Value& left, const Value& right)
+        {
+            if(left.type() == Type::STRING && right.type() == Type::STRING)
+            {
+                return string_less_than(left.as<std::string_view>(), right.as<std::string_view>()) ? LessThan::LESS : LessThan::NOT_LESS;
+            }
+
+            const auto a = to_number(left);
+            const auto b = to_number(right);
+            if(std::isnan(a) || std::isnan(b))
+            {
+                return LessThan::UNDEFINED;
+            }
+            return a < b ? LessThan::LESS : LessThan::NOT_LESS;
+        }
+    }
+
+    double to_number(const Value& value)
+    {
+        switch(value.type())
+        {
+        case Type::NUMBER:
+            return value.as<double>();
+        case Type::BOOLEAN:
+            return value.as<bool>() ? 1 : 0;
+        case Type::STRING:
+            return string_to_number(value.as<std::string_view>());
+        case Type::NIL:
+            return 0;
+        default:
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+
+    double string_to_number(std::string_view string)
+    {
+        string = trim(string);
+        if(string.empty())
+        {
+            return 0;
+        }
+
+        if(string.size() > 2 && string[0] == '0')
+        {
+            switch(string[1])
+            {
+            case 'x':
+            case 'X':
+                return radix_integer(string.substr(2), 4);
+            case 'o':
+            case 'O':
+                return radix_integer(string.substr(2), 3);
+            case 'b':
+            case 'B':
+                return radix_integer(string.substr(2), 1);
+            default:
+                break;
+            }
+        }
+
+        bool negative = false;
+        if(string.front() == '+' || string.front() == '-')
+        {
+            negative = string.front() == '-';
+            string.remove_prefix(1);
+        }
+
+        double result;
+        if(string == "Infinity")
+        {
+            result = std::numeric_limits<double>::infinity();
+        } else if(!is_unsigned_decimal(string))
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        } else if(const auto [end, error] = std::from_chars(string.data(), string.data() + string.size(), result); error == std::errc::result_out_of_range)
+        {
+            // from_chars leaves result alone when it over- or underflows, strtod saturates to infinity or zero
+            result = std::strtod(std::string(string).c_str(), nullptr);
+        }
+
+        return negative ? -result : result;
+    }
+
+    std::string number_to_string(const double number)
+    {
+        if(std::isnan(number))
+        {
+            return "NaN";
+        }
+        if(number == 0)
+        {
+            return "0";
+        }
+        if(number < 0)
+        {
+            return "-" + number_to_string(-number);
+        }
+        if(std::isinf(number))
+        {
+            return "Infinity";
+        }
+
+        // Shortest digits that round-trip, as d.ddde±x; the spec's k digits and exponent n fall out of that
+        char buffer[32];
+        const auto [end, error] = std::to_chars(buffer, std::end(buffer), number, std::chars_format::scientific);
+        const std::string_view scientific(buffer, end);
+        const auto e = scientific.find('e');
+
+        std::string digits(1, scientific[0]);
+        if(e > 1)
+        {
+            digits.append(scientific.substr(2, e - 2));
+        }
+        int exponent = 0;
+        std::from_chars(scientific.data() + e + (scientific[e + 1] == '+' ? 2 : 1), end, exponent);
+
+        const auto k = static_cast<int>(digits.size());
+        const auto n = exponent + 1;
+        if(k <= n && n <= 21)
+        {
+            return digits + std::string(n - k, '0');
+        }
+        if(0 < n && n <= 21)
+        {
+            return digits.substr(0, n) + "." + digits.substr(n);
+        }
+        if(-6 < n && n <= 0)
+        {
+            return "0." + std::string(-n, '0') + digits;
+        }
+
+        const auto exponent_part = std::string(n - 1 < 0 ? "e-" : "e+") + std::to_string(std::abs(n - 1));
+        if(k == 1)
+        {
+            return digits + exponent_part;
+        }
+        return digits.substr(0, 1) + "." + digits.substr(1) + exponent_part;
+    }
+
+    std::string to_string(const Value& value)
+    {
+        switch(value.type())
+        {
+        case Type::STRING:
+            return std::string(value.as<std::string_view>());
+        case Type::NUMBER:
+            return number_to_string(value.as<double>());
+        case Type::BOOLEAN:
+            return value.as<bool>() ? "true" : "false";
+        case Type::NIL:
+            return "null";
+        default:
+            return "undefined";
+        }
+    }
+
+    bool to_boolean(const Value& value)
+    {
+        switch(value.type())
+        {
+        case Type::NUMBER:
+        {
+            const auto number = value.as<double>();
+            return number != 0 && !std::isnan(number);
+        }
+        case Type::BOOLEAN:
+            return value.as<bool>();
+        case Type::STRING:
+            return !value.as<std::string_view>().empty();
+        case Type::UNDEFINED:
+        case Type::NIL:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    int32_t to_int32(const double number)
+    {
+        return static_cast<int32_t>(to_uint32(number));
+    }
+
+    uint32_t to_uint32(const double number)
+    {
+        if(!std::isfinite(number) || number == 0)
+        {
+            return 0;
+        }
+
+        constexpr double two_to_32 = 4294967296.0;
+        auto modulo = std::fmod(std::trunc(number), two_to_32);
+        if(modulo < 0)
+        {
+            modulo += two_to_32;
+        }
+        return static_cast<uint32_t>(modulo);
+    }
+
+    bool is_strictly_equal(const Value& left, const Value& right)
+    {
+        if(left.type() != right.type())
+        {
+            return false;
+        }
+
+        switch(left.type())
+        {
+        case Type::NUMBER:
+            return left.as<double>() == right.as<double>();
+        case Type::STRING:
+            return left.as<std::string_view>() == right.as<std::string_view>();
+        case Type::BOOLEAN:
+            return left.as<bool>() == right.as<bool>();
+        case Type::UNDEFINED:
+        case Type::NIL:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool is_loosely_equal(const Value& left, const Value& right)
+    {
+        if(left.type() == right.type())
+        {
+            return is_strictly_equal(left, right);
+        }
+
+        const auto is_nullish = [](const Value& value) { return value.type() == Type::UNDEFINED || value.type() == Type::NIL; };
+        if(is_nullish(left) || is_nullish(right))
+        {
+            return is_nullish(left) && is_nullish(right);
+        }
+
+        // What's left are numbers, strings and booleans of different types, all of which compare as numbers
+        return to_number(left) == to_number(right);
+    }
+
+    std::optional<Value> binary_operation(const AST::BinaryExpression::Op op, const Value& left, const Value& right)
+    {
+        using Op = AST::BinaryExpression::Op;
+        if(!is_primitive(left) || !is_primitive(right))
+        {
+            return std::nullopt;
+        }
+
+        switch(op)
+        {
+        case Op::PLUS:
+            if(left.type() == Type::STRING || right.type() == Type::STRING)
+            {
+                return Value(to_string(left) + to_string(right));
+            }
+            return Value(to_number(left) + to_number(right));
+        case Op::MINUS:
+            return Value(to_number(left) - to_number(right));
+        case Op::MULT:
+            return Value(to_number(left) * to_number(right));
+        case Op::DIV:
+            return Value(to_number(left) / to_number(right));
+        case Op::MOD:
+            // fmod has the same sign and NaN/infinity rules as %
+            return Value(std::fmod(to_number(left), to_number(right)));
+        case Op::AND:
+            return Value(static_cast<double>(to_int32(to_number(left)) & to_int32(to_number(right))));
+        case Op::OR:
+            return Value(static_cast<double>(to_int32(to_number(left)) | to_int32(to_number(right))));
+        case Op::XOR:
+            return Value(static_cast<double>(to_int32(to_number(left)) ^ to_int32(to_number(right))));
+        case Op::SHIFT_LEFT:
+            return Value(static_cast<double>(static_cast<int32_t>(to_uint32(to_number(left)) << (to_uint32(to_number(right)) & 31))));
+        case Op::SHIFT_RIGHT:
+            return Value(static_cast<double>(to_int32(to_number(left)) >> (to_uint32(to_number(right)) & 31)));
+        case Op::EQUAL_EQUAL:
+            return Value(is_loosely_equal(left, right));
+        case Op::NOT_EQUAL:
+            return Value(!is_loosely_equal(left, right));
+        case Op::EQUAL_EQUAL_EQUAL:
+            return Value(is_strictly_equal(left, right));
+        case Op::NOT_EQUAL_EQUAL:
+            return Value(!is_strictly_equal(left, right));
+        case Op::LESS_THAN:
+        case Op::GREATER_THAN:
+        case Op::LESS_THAN_EQUAL_TO:
+        case Op::GREATER_THAN_EQUAL_TO:
+        {
+            // a > b is b < a, a <= b is !(b < a), a >= b is !(a < b); undefined (NaN) is false for all of them
+            const bool swapped = op == Op::GREATER_THAN || op == Op::LESS_THAN_EQUAL_TO;
+            const bool negated = op == Op::LESS_THAN_EQUAL_TO || op == Op::GREATER_THAN_EQUAL_TO;
+            const auto result = swapped ? is_less_than(right, left) : is_less_than(left, right);
+            if(result == LessThan::UNDEFINED)
+            {
+                return Value(false);
+            }
+            return Value((result == LessThan::LESS) != negated);
+        }
+        default:
+            return std::nullopt;
+        }
+    }
+
+    std::optional<Value> unary_operation(const AST::UnaryExpression::Op op, const Value& operand)
+    {
+        using Op = AST::UnaryExpression::Op;
+        if(!is_primitive(operand))
+        {
+            return std::nullopt;
+        }
+
+        switch(op)
+        {
+        case Op::MINUS:
+            return Value(-to_number(operand));
+        case Op::PLUS:
+            return Value(to_number(operand));
+        case Op::NOT:
+            return Value(!to_boolean(operand));
+        }
+
+        return std::nullopt;
+    }
+}
@@ -1,120 +1,801 @@
 #include "Parser.h"
 
+#include <algorithm>
+
 #include "AST.h"
+#include "Operations.h"
+#include "ThreadPool.h"
 
 namespace JS
 {
+    namespace
+    {
+        // How tightly each infix operator holds its operands, indexed by TokenType; 0 means not an infix operator.
+        // An operator takes the expression on its left if left_power is at least the caller's minimum, then parses
+        // its right operand with right_power as the new minimum, so left < right is left-associative and
+        // left > right is right-associative
+        struct InfixOperator
+        {
+            uint8_t left_power{0};
+            uint8_t right_power{0};
+            AST::BinaryExpression::Op op{};
+            // = and the compound assignments; compound ones also apply op
+            bool is_assignment{false};
+            bool is_compound{false};
+        };
+
+        constexpr auto infix_operators = []
+        {
+            using Op = AST::BinaryExpression::Op;
+            std::array<InfixOperator, std::size(TokenTable::all)> table{};
+
+            const auto binary = [&table](const TokenType type, const uint8_t level, const Op op)
+            {
+                table[static_cast<size_t>(type)] = {static_cast<uint8_t>(2 * level + 1), static_cast<uint8_t>(2 * level + 2), op};
+            };
+            const auto compound_assignment = [&table](const TokenType type, const Op op)
+            {
+                table[static_cast<size_t>(type)] = {2, 1, op, true, true};
+            };
+
+            table[static_cast<size_t>(TokenType::EQUALS)] = {2, 1, Op{}, true, false};
+            compound_assignment(TokenType::PLUS_EQUALS, Op::PLUS);
+            compound_assignment(TokenType::MINUS_EQUALS, Op::MINUS);
+            compound_assignment(TokenType::MULT_EQUALS, Op::MULT);
+            compound_assignment(TokenType::DIV_EQUALS, Op::DIV);
+            compound_assignment(TokenType::MOD_EQUALS, Op::MOD);
+            compound_assignment(TokenType::AND_EQUALS, Op::AND);
+            compound_assignment(TokenType::XOR_EQUALS, Op::XOR);
+            compound_assignment(TokenType::OR_EQUALS, Op::OR);
+
+            binary(TokenType::OR, 2, Op::OR);
+            binary(TokenType::XOR, 3, Op::XOR);
+            binary(TokenType::AND, 4, Op::AND);
+            binary(TokenType::EQUAL_EQUAL, 5, Op::EQUAL_EQUAL);
+            binary(TokenType::NOT_EQUAL, 5, Op::NOT_EQUAL);
+            binary(TokenType::EQUAL_EQUAL_EQUAL, 5, Op::EQUAL_EQUAL_EQUAL);
+            binary(TokenType::NOT_EQUAL_EQUAL, 5, Op::NOT_EQUAL_EQUAL);
+            binary(TokenType::LESS_THAN, 6, Op::LESS_THAN);
+            binary(TokenType::GREATER_THAN, 6, Op::GREATER_THAN);
+            binary(TokenType::LESS_THAN_EQUAL_TO, 6, Op::LESS_THAN_EQUAL_TO);
+            binary(TokenType::GREATER_THAN_EQUAL_TO, 6, Op::GREATER_THAN_EQUAL_TO);
+            binary(TokenType::SHIFT_LEFT, 7, Op::SHIFT_LEFT);
+            binary(TokenType::SHIFT_RIGHT, 7, Op::SHIFT_RIGHT);
+            binary(TokenType::PLUS, 8, Op::PLUS);
+            binary(TokenType::MINUS, 8, Op::MINUS);
+            binary(TokenType::MULT, 9, Op::MULT);
+            binary(TokenType::DIV, 9, Op::DIV);
+            binary(TokenType::MOD, 9, Op::MOD);
+            return table;
+        }();
+
+        // Operand of a prefix -, + or !: tighter than every binary operator
+        constexpr uint8_t prefix_binding_power = 21;
+
+        constexpr TokenSet operand_start(TokenType::IDENTIFIER, TokenType::NUMBER, TokenType::SINGLE_QUOTED_STRING,
+            TokenType::DOUBLE_QUOTED_STRING, TokenType::TRUE_LITERAL, TokenType::FALSE_LITERAL, TokenType::NULL_LITERAL,
+            TokenType::LEFT_PAREN, TokenType::MINUS, TokenType::PLUS, TokenType::EXCLAMATION_MARK);
+
+        constexpr TokenSet statement_start = operand_start | TokenSet(TokenType::VAR, TokenType::LET, TokenType::CONST,
+            TokenType::FUNCTION, TokenType::IF, TokenType::WHILE, TokenType::RETURN);
+
+        // Which tokens may follow each token type, for the pre-scan of a skipped body. Only pairs the grammar rejects
+        // in every context are left out, so the pre-scan never rejects a body the full parse would accept. Token types
+        // the grammar has no place for at all (for, [, ++, ...) have no entry and may follow nothing
+        constexpr auto token_followers = []
+        {
+            std::array<TokenSet, std::size(TokenTable::all)> table;
+            const auto set = [&table](const TokenType type, const TokenSet& followers)
+            {
+                table[static_cast<size_t>(type)] = followers;
+            };
+
+            auto any = statement_start | TokenSet(TokenType::RIGHT_PAREN, TokenType::LEFT_CURLY_BRACE,
+                TokenType::RIGHT_CURLY_BRACE, TokenType::COMMA, TokenType::SEMICOLON, TokenType::ELSE, TokenType::END_OF_FILE);
+            for(size_t type = 0; type < table.size(); ++type)
+            {
+                if(infix_operators[type].left_power != 0)
+                {
+                    any = any | TokenSet(static_cast<TokenType>(type));
+                    table[type] = operand_start;
+                }
+            }
+
+            for(const auto type : {TokenType::IDENTIFIER, TokenType::NUMBER, TokenType::SINGLE_QUOTED_STRING,
+                    TokenType::DOUBLE_QUOTED_STRING, TokenType::TRUE_LITERAL, TokenType::FALSE_LITERAL,
+                    TokenType::NULL_LITERAL, TokenType::RIGHT_PAREN, TokenType::RIGHT_CURLY_BRACE})
+            {
+                set(type, any);
+            }
+            set(TokenType::EXCLAMATION_MARK, operand_start);
+            set(TokenType::LEFT_PAREN, operand_start | TokenSet(TokenType::RIGHT_PAREN));
+            set(TokenType::COMMA, operand_start | TokenSet(TokenType::RIGHT_PAREN));
+            set(TokenType::LEFT_CURLY_BRACE, statement_start | TokenSet(TokenType::SEMICOLON, TokenType::RIGHT_CURLY_BRACE));
+            set(TokenType::SEMICOLON, statement_start | TokenSet(TokenType::SEMICOLON, TokenType::RIGHT_CURLY_BRACE,
+                TokenType::ELSE, TokenType::END_OF_FILE));
+            set(TokenType::ELSE, statement_start | TokenSet(TokenType::LEFT_CURLY_BRACE));
+            set(TokenType::RETURN, operand_start | TokenSet(TokenType::SEMICOLON, TokenType::RIGHT_CURLY_BRACE,
+                TokenType::END_OF_FILE));
+            for(const auto type : {TokenType::VAR, TokenType::LET, TokenType::CONST, TokenType::FUNCTION})
+            {
+                set(type, TokenSet(TokenType::IDENTIFIER));
+            }
+            set(TokenType::IF, TokenSet(TokenType::LEFT_PAREN));
+            set(TokenType::WHILE, TokenSet(TokenType::LEFT_PAREN));
+            return table;
+        }();
+
+        static_assert(!token_followers[static_cast<size_t>(TokenType::LET)].contains(TokenType::EQUALS));
+        static_assert(!token_followers[static_cast<size_t>(TokenType::EQUALS)].contains(TokenType::SEMICOLON));
+        static_assert(token_followers[static_cast<size_t>(TokenType::IDENTIFIER)].contains(TokenType::PLUS_EQUALS));
+        static_assert(!token_followers[static_cast<size_t>(TokenType::IDENTIFIER)].contains(TokenType::INCREMENT));
+
+        struct DepthGuard
+        {
+            explicit DepthGuard(size_t& depth) : m_depth(depth) { ++m_depth; }
+            ~DepthGuard() { --m_depth; }
+
+            size_t& m_depth;
+        };
+
+        // Whether a var declared somewhere in block (not in a nested function) hoists out of it
+        bool declares_var(const AST::BlockStatement& block)
+        {
+            for(const auto* statement : block.statements())
+            {
+                switch(statement->kind())
+                {
+                case AST::Kind::VARIABLE_DECLARATION:
+                    if(static_cast<const AST::VariableDeclaration&>(*statement).declaration_kind() == AST::VariableDeclaration::DeclarationKind::VAR)
+                    {
+                        return true;
+                    }
+                    break;
+                case AST::Kind::BLOCK_STATEMENT:
+                    if(declares_var(static_cast<const AST::BlockStatement&>(*statement)))
+                    {
+                        return true;
+                    }
+                    break;
+                case AST::Kind::IF_STATEMENT:
+                {
+                    const auto& if_statement = static_cast<const AST::IfStatement&>(*statement);
+                    if(declares_var(if_statement.body()) || (if_statement.alternate() && declares_var(*if_statement.alternate())))
+                    {
+                        return true;
+                    }
+                    break;
+                }
+                case AST::Kind::WHILE_STATEMENT:
+                    if(declares_var(static_cast<const AST::WhileStatement&>(*statement).body()))
+                    {
+                        return true;
+                    }
+                    break;
+                case AST::Kind::FOR_STATEMENT:
+                    if(declares_var(static_cast<const AST::ForStatement&>(*statement).body()))
+                    {
+                        return true;
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            return false;
+        }
+    }
+
     AST Parser::parse()
     {
-        m_index = 0;
-        auto program = std::make_shared<AST::Program>();
-        auto global_scope = std::make_shared<Scope>();
+        m_arena = std::make_shared<Arena>();
+        m_deferred_bodies.clear();
+        if(m_options.function_bodies == ParserOptions::FunctionBodies::PARALLEL && ThreadPool::the().thread_count() < 2)
+        {
+            // Collecting body tokens for a single worker is pure overhead
+            m_options.function_bodies = ParserOptions::FunctionBodies::EAGER;
+        }
+        m_statement_scratch.clear();
+        m_expression_scratch.clear();
+        m_parameter_scratch.clear();
+
+        auto lazy_options = m_options;
+        lazy_options.function_bodies = ParserOptions::FunctionBodies::LAZY;
+        m_lazy_options = make<ParserOptions>(lazy_options);
+
+        auto program = make<AST::Program>(parse_block(TokenSet(TokenType::END_OF_FILE)));
+        if(!m_deferred_bodies.empty())
+        {
+            parse_deferred_bodies();
+        }
+
+        return {std::move(m_arena), program};
+    }
+
+    AST Parser::reparse(const AST& previous, const TextEdit& edit)
+    {
+        m_edit_delta = edit.delta();
+        for(const auto& node : previous.program()->statements())
+        {
+            collect_reusable_functions(node, edit);
+        }
+
+        auto ast = parse();
+        m_reusable_functions.clear();
+        return ast;
+    }
+
+    void Parser::collect_reusable_functions(const AST::Node* node, const TextEdit& edit)
+    {
+        // Only lazy declarations: the new one is pre-parsed from its old summary and parses its body from the new
+        // text, so nothing is shared with the previous tree. A declaration the edit is inside is pre-parsed again,
+        // and so are the functions nested in it once its body is parsed
+        if(node->kind() != AST::Kind::FUNCTION_DECLARATION)
+        {
+            return;
+        }
+        const auto& function = static_cast<const AST::FunctionDeclaration&>(*node);
+        if(!function.is_lazy())
+        {
+            return;
+        }
+
+        const auto& span = function.span();
+        if(span.end <= edit.start)
+        {
+            m_reusable_functions.emplace(span.start, &function);
+        } else if(span.start >= edit.start + edit.removed_length)
+        {
+            m_reusable_functions.emplace(static_cast<uint32_t>(span.start + m_edit_delta), &function);
+        }
+    }
+
+    AST::FunctionDeclaration* Parser::reuse_function_declaration()
+    {
+        const auto reusable = m_reusable_functions.find(peek().offset);
+        if(reusable == m_reusable_functions.end())
+        {
+            return nullptr;
+        }
 
-        for(const auto& node : parse_block({TokenType::END_OF_FILE}))
+        // Same text at the mapped position, so the same declaration: skip its tokens instead of pre-parsing them
+        const auto& old = *reusable->second;
+        const auto shift = peek().offset - static_cast<int64_t>(old.span().start);
+        const Span span{peek().file_id, peek().offset, static_cast<uint32_t>(old.span().end + shift)};
+        while(peek().offset < span.end && peek().type != TokenType::END_OF_FILE)
         {
-            program->add_statement(node);
+            consume();
         }
 
-        return {program, global_scope};
+        const auto base = m_parameter_scratch.size();
+        for(const auto& parameter : old.parameters())
+        {
+            m_parameter_scratch.push_back(make<AST::Parameter>(parameter->name()));
+        }
+        auto params = take_scratch(m_parameter_scratch, base);
+        auto function = make<AST::FunctionDeclaration>(old.name(), params, *m_arena, old.body_offset(), m_arena->copy(old.free_names()), *m_lazy_options);
+        function->set_span(span);
+        return function;
     }
 
-    std::vector<std::shared_ptr<AST::Statement>> Parser::parse_block(const std::vector<TokenType>& stoppers)
+    std::span<AST::Statement* const> Parser::parse_block(const TokenSet& stoppers)
     {
-        std::vector<std::shared_ptr<AST::Statement>> statements;
-        while(!match(stoppers) && peek().type != TokenType::END_OF_FILE)
+        const auto base = m_statement_scratch.size();
+        while(!match_any(stoppers) && peek().type != TokenType::END_OF_FILE)
         {
-            // Detect token type and dispatch
-            if(match({TokenType::VAR}) || match({TokenType::LET}))  // TODO: Separate these
+            if(match(TokenType::SEMICOLON))
             {
-                statements.push_back(parse_variable_declaration());
-            } else if(match({TokenType::FUNCTION}))
+                consume();
+                continue;
+            }
+            // Push after parsing: a nested block pushes (and pops) its own statements in between
+            if(auto statement = parse_statement())
             {
-                statements.push_back(parse_function_declaration());
-            } else if(match({TokenType::IF}))
+                m_statement_scratch.push_back(statement);
+            }
+        }
+
+        return take_scratch(m_statement_scratch, base);
+    }
+
+    AST::Statement* Parser::parse_statement()
+    {
+        // Detect token type and dispatch
+        if(match_any(TokenSet(TokenType::VAR, TokenType::LET, TokenType::CONST)))
+        {
+            return parse_variable_declaration();
+        } else if(match(TokenType::FUNCTION))
+        {
+            return parse_function_declaration();
+        } else if(match(TokenType::IF))
+        {
+            return parse_if_statement();
+        } else if(match(TokenType::WHILE))
+        {
+            return parse_while_statement();
+        } else if(match(TokenType::RETURN))
+        {
+            return parse_return_statement();
+        }
+
+        return parse_expression_statement();
+    }
+
+    AST::BlockStatement* Parser::parse_body()
+    {
+        if(!match(TokenType::LEFT_CURLY_BRACE))
+        {
+            AST::Statement* const statement = parse_statement();
+            if(!statement)
             {
-                statements.push_back(parse_if_statement());
-            } else if(match({TokenType::RETURN}))
+                return make<AST::BlockStatement>(std::span<AST::Statement* const>());
+            }
+            return make<AST::BlockStatement>(m_arena->copy(std::span(&statement, 1)));
+        }
+
+        consume(TokenType::LEFT_CURLY_BRACE);
+        auto body = parse_block(TokenSet(TokenType::RIGHT_CURLY_BRACE));
+        consume(TokenType::RIGHT_CURLY_BRACE);
+        return make<AST::BlockStatement>(body);
+    }
+
+    AST::Expression* Parser::parse_expression(const uint8_t min_binding_power)
+    {
+        const DepthGuard depth_guard(m_expression_depth);
+        if(m_expression_depth > max_expression_depth)
+        {
+            throw std::runtime_error(std::format("Expression nested too deeply at {}", peek().span().to_string()));
+        }
+
+        // Pratt loop: the left operand keeps absorbing operators until one binds less tightly than our caller's.
+        // Each operator costs one iteration; only its right operand recurses, and only one level deeper
+        auto left = parse_prefix_expression();
+        while(true)
+        {
+            const auto& infix = infix_operators[static_cast<size_t>(peek().type)];
+            if(infix.left_power == 0 || infix.left_power < min_binding_power)
+            {
+                break;
+            }
+
+            const auto operator_token = consume();
+            auto right = parse_expression(infix.right_power);
+            if(!infix.is_assignment)
             {
-                statements.push_back(parse_return_statement());
+                left = make_binary(left, right, infix.op);
+                continue;
             }
+
+            if(left->kind() != AST::Kind::VARIABLE_EXPRESSION)
+            {
+                throw std::runtime_error(std::format("Invalid assignment target at {}", operator_token.span().to_string()));
+            }
+            const auto target = static_cast<const AST::VariableExpression*>(left);
+            if(infix.is_compound)
+            {
+                right = make<AST::BinaryExpression>(left, right, infix.op);
+            }
+            left = make<AST::VariableAssignment>(target->name(), right);
         }
 
-        return {};
+        return left;
     }
 
-    std::shared_ptr<AST::Expression> Parser::parse_expression()
+    AST::Expression* Parser::parse_prefix_expression()
     {
-        not_implemented();
+        switch(peek().type)
+        {
+        case TokenType::NUMBER:
+        case TokenType::SINGLE_QUOTED_STRING:
+        case TokenType::DOUBLE_QUOTED_STRING:
+        case TokenType::TRUE_LITERAL:
+        case TokenType::FALSE_LITERAL:
+        case TokenType::NULL_LITERAL:
+            return parse_literal();
+        case TokenType::IDENTIFIER:
+            if(peek(1).type == TokenType::LEFT_PAREN)
+            {
+                return parse_function_call();
+            }
+            return make<AST::VariableExpression>(consume().atom());
+        case TokenType::LEFT_PAREN:
+        {
+            consume();
+            auto expression = parse_expression();
+            consume(TokenType::RIGHT_PAREN);
+            return expression;
+        }
+        case TokenType::MINUS:
+            consume();
+            return make_unary(parse_expression(prefix_binding_power), AST::UnaryExpression::Op::MINUS);
+        case TokenType::PLUS:
+            consume();
+            return make_unary(parse_expression(prefix_binding_power), AST::UnaryExpression::Op::PLUS);
+        case TokenType::EXCLAMATION_MARK:
+            consume();
+            return make_unary(parse_expression(prefix_binding_power), AST::UnaryExpression::Op::NOT);
+        default:
+            throw std::runtime_error(std::format("Unexpected token {}", peek().to_string()));
+        }
     }
-    std::shared_ptr<AST::FunctionCall> Parser::parse_function_call()
+
+    AST::Expression* Parser::make_binary(AST::Expression* left, AST::Expression* right, const AST::BinaryExpression::Op op)
     {
-        auto name = consume();
-        assert(name.type == TokenType::IDENTIFIER);
-        consume(TokenType::LEFT_PAREN);
-        auto params = parse_parameters();
-        consume(TokenType::RIGHT_PAREN);
-        consume_semicolon_if_exists();
-        return std::make_shared<AST::FunctionCall>(name.unwrap<std::string>(), params);
+        if(m_options.fold_constants && left->kind() == AST::Kind::LITERAL && right->kind() == AST::Kind::LITERAL)
+        {
+            const auto& left_value = static_cast<const AST::Literal&>(*left).value();
+            const auto& right_value = static_cast<const AST::Literal&>(*right).value();
+            if(auto result = Operations::binary_operation(op, left_value, right_value))
+            {
+                return make<AST::Literal>(std::move(*result));
+            }
+        }
+
+        return make<AST::BinaryExpression>(left, right, op);
     }
 
-    std::shared_ptr<AST::FunctionCallStatement> Parser::parse_function_call_statement()
+    AST::Expression* Parser::make_unary(AST::Expression* operand, const AST::UnaryExpression::Op op)
     {
-        auto function_call = parse_function_call();
-        consume_semicolon_if_exists();
-        return std::make_shared<AST::FunctionCallStatement>(function_call);
+        if(m_options.fold_constants && operand->kind() == AST::Kind::LITERAL)
+        {
+            if(auto result = Operations::unary_operation(op, static_cast<const AST::Literal&>(*operand).value()))
+            {
+                return make<AST::Literal>(std::move(*result));
+            }
+        }
+
+        return make<AST::UnaryExpression>(operand, op);
     }
 
+    AST::FunctionCall* Parser::parse_function_call()
+    {
+        auto name = consume(TokenType::IDENTIFIER);
+        consume(TokenType::LEFT_PAREN);
+
+        const auto base = m_expression_scratch.size();
+        while(peek().type != TokenType::RIGHT_PAREN && peek().type != TokenType::END_OF_FILE)
+        {
+            auto argument = parse_expression();
+            m_expression_scratch.push_back(argument);
+            if(peek().type != TokenType::RIGHT_PAREN)
+            {
+                consume(TokenType::COMMA);
+            }
+        }
+
+        consume(TokenType::RIGHT_PAREN);
+        return make<AST::FunctionCall>(name.atom(), take_scratch(m_expression_scratch, base));
+    }
 
-    std::shared_ptr<AST::FunctionDeclaration> Parser::parse_function_declaration()
+
+    AST::FunctionDeclaration* Parser::parse_function_declaration()
     {
-        consume(TokenType::FUNCTION);
-        const auto identifier = consume();
-        assert(identifier.type == TokenType::IDENTIFIER);
+        if(!m_reusable_functions.empty())
+        {
+            if(auto reused = reuse_function_declaration())
+            {
+                return reused;
+            }
+        }
+
+        const auto function_keyword = consume(TokenType::FUNCTION);
+        const auto identifier = consume(TokenType::IDENTIFIER);
         consume(TokenType::LEFT_PAREN);
         auto params = parse_parameters();
         consume(TokenType::RIGHT_PAREN);
-        consume(TokenType::LEFT_CURLY_BRACE);
-        auto body = parse_block({TokenType::RIGHT_CURLY_BRACE});
-        consume(TokenType::RIGHT_CURLY_BRACE);
 
-        return std::make_shared<AST::FunctionDeclaration>(identifier.unwrap<std::string>(), params, std::make_shared<AST::BlockStatement>(body));
+        AST::FunctionDeclaration* function;
+        Token closing_brace;
+        if(m_options.function_bodies != ParserOptions::FunctionBodies::EAGER)
+        {
+            const auto body_offset = peek().offset - function_keyword.offset;
+            std::vector<Token>* tokens = nullptr;
+            if(m_options.function_bodies == ParserOptions::FunctionBodies::PARALLEL)
+            {
+                tokens = &m_deferred_bodies.emplace_back().tokens;
+            }
+
+            closing_brace = skip_function_body(tokens);
+
+            std::ranges::sort(m_identifier_scratch, {}, &Atom::id);
+            const auto [last, end] = std::ranges::unique(m_identifier_scratch);
+            m_identifier_scratch.erase(last, end);
+            const auto free_names = m_arena->copy(std::span<const Atom>(m_identifier_scratch));
+
+            function = make<AST::FunctionDeclaration>(identifier.atom(), params, *m_arena, body_offset, free_names, *m_lazy_options);
+            if(tokens)
+            {
+                m_deferred_bodies.back().function = function;
+            }
+        } else
+        {
+            consume(TokenType::LEFT_CURLY_BRACE);
+            auto body = parse_block(TokenSet(TokenType::RIGHT_CURLY_BRACE));
+            closing_brace = consume(TokenType::RIGHT_CURLY_BRACE);
+            function = make<AST::FunctionDeclaration>(identifier.atom(), params, make<AST::BlockStatement>(body));
+        }
+
+        function->set_span({function_keyword.file_id, function_keyword.offset, closing_brace.offset + closing_brace.length});
+        return function;
     }
-    std::shared_ptr<AST::BinaryExpression> Parser::parse_binary_expression()
+
+    Token Parser::skip_function_body(std::vector<Token>* tokens)
     {
-        not_implemented();
+        // The lexer still sees every token (braces inside strings and comments don't count), but nothing is built.
+        // Mismatched brackets and token pairs that can never be adjacent are the errors we can report without
+        // parsing, so a script with those doesn't start running; the rest surface on the full parse
+        m_bracket_scratch.clear();
+        m_bracket_scratch.push_back(TokenType::RIGHT_CURLY_BRACE);
+        m_identifier_scratch.clear();
+        const auto opening_brace = consume(TokenType::LEFT_CURLY_BRACE);
+        if(tokens)
+        {
+            tokens->push_back(opening_brace);
+        }
+
+        auto previous = opening_brace.type;
+        while(true)
+        {
+            const auto token = consume();
+            if(tokens)
+            {
+                tokens->push_back(token);
+            }
+            if(token.type != TokenType::END_OF_FILE && !token_followers[static_cast<size_t>(previous)].contains(token.type))
+            {
+                throw std::runtime_error(std::format("Unexpected token {}", token.to_string()));
+            }
+            previous = token.type;
+
+            switch(token.type)
+            {
+            case TokenType::IDENTIFIER:
+                m_identifier_scratch.push_back(token.atom());
+                break;
+            case TokenType::LEFT_CURLY_BRACE:
+                m_bracket_scratch.push_back(TokenType::RIGHT_CURLY_BRACE);
+                break;
+            case TokenType::LEFT_PAREN:
+                m_bracket_scratch.push_back(TokenType::RIGHT_PAREN);
+                break;
+            case TokenType::RIGHT_CURLY_BRACE:
+            case TokenType::RIGHT_PAREN:
+                if(token.type != m_bracket_scratch.back())
+                {
+                    throw std::runtime_error(std::format("Unexpected {} at {}, expected {}", TokenTable::name(token.type), token.span().to_string(), TokenTable::name(m_bracket_scratch.back())));
+                }
+                m_bracket_scratch.pop_back();
+                if(m_bracket_scratch.empty())
+                {
+                    if(tokens)
+                    {
+                        auto end = token;
+                        end.type = TokenType::END_OF_FILE;
+                        end.offset += end.length;
+                        end.length = 0;
+                        tokens->push_back(end);
+                    }
+                    return token;
+                }
+                break;
+            case TokenType::END_OF_FILE:
+                throw std::runtime_error(std::format("Unterminated function body at {}", token.span().to_string()));
+            default:
+                break;
+            }
+        }
     }
-    std::shared_ptr<AST::Literal> Parser::parse_literal()
+
+    void Parser::parse_deferred_bodies()
     {
-        not_implemented();
+        // Tokens are already lexed and atoms interned, so workers only read shared state. Each batch builds into
+        // its own arena (arenas aren't thread safe) and the tree's arena keeps those alive
+        struct Batch
+        {
+            std::span<DeferredBody> bodies;
+            std::shared_ptr<Arena> arena{std::make_shared<Arena>()};
+        };
+
+        std::vector<Batch> batches;
+        size_t first = 0;
+        size_t batch_tokens = 0;
+        for(size_t i = 0; i < m_deferred_bodies.size(); ++i)
+        {
+            batch_tokens += m_deferred_bodies[i].tokens.size();
+            if(batch_tokens >= m_options.parallel_batch_tokens || i + 1 == m_deferred_bodies.size())
+            {
+                batches.push_back({std::span(m_deferred_bodies).subspan(first, i + 1 - first)});
+                first = i + 1;
+                batch_tokens = 0;
+            }
+        }
+
+        // Functions nested in the deferred bodies are left for their first use
+        const auto* options = m_lazy_options;
+
+        std::vector<std::future<void>> done;
+        done.reserve(batches.size());
+        for(auto& batch : batches)
+        {
+            done.push_back(ThreadPool::the().submit([&batch, options]
+            {
+                for(auto& [function, tokens] : batch.bodies)
+                {
+                    TokenStream stream(tokens);
+                    Parser parser(stream, *options);
+                    parser.m_arena = batch.arena;
+                    parser.m_lazy_options = options;
+                    function->set_body(parser.parse_body());
+                    parser.consume(TokenType::END_OF_FILE);
+                    tokens = {};
+                }
+            }));
+        }
+
+        // Every batch has to finish before anything is rethrown, they write into this tree
+        std::exception_ptr error;
+        for(size_t i = 0; i < batches.size(); ++i)
+        {
+            try
+            {
+                done[i].get();
+            }
+            catch(...)
+            {
+                if(!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+            m_arena->retain(std::move(batches[i].arena));
+        }
+
+        m_deferred_bodies.clear();
+        if(error)
+        {
+            std::rethrow_exception(error);
+        }
     }
 
-    std::vector<std::shared_ptr<AST::Parameter>> Parser::parse_parameters()
+    AST::BlockStatement* Parser::parse_lazy_body(Arena& arena, const Span& body, const ParserOptions& options)
     {
-        not_implemented();
+        Lexer lexer(body.file_id, body.start, body.end);
+        TokenStream tokens(lexer);
+        Parser parser(tokens, options);
+
+        // The arena is owned by the tree the declaration belongs to, the parser only borrows it
+        parser.m_arena = std::shared_ptr<Arena>(std::shared_ptr<Arena>(), &arena);
+        parser.m_lazy_options = &options;
+        auto block = parser.parse_body();
+        parser.consume(TokenType::END_OF_FILE);
+        return block;
+    }
+    AST::Literal* Parser::parse_literal()
+    {
+        const auto token = consume();
+        switch(token.type)
+        {
+        case TokenType::NUMBER:
+            return make<AST::Literal>(Value(token.unwrap<double>()));
+        case TokenType::SINGLE_QUOTED_STRING:
+        case TokenType::DOUBLE_QUOTED_STRING:
+            return make<AST::Literal>(Value(AtomTable::the().intern(token.unwrap<std::string_view>())));
+        case TokenType::TRUE_LITERAL:
+            return make<AST::Literal>(Value(true));
+        case TokenType::FALSE_LITERAL:
+            return make<AST::Literal>(Value(false));
+        case TokenType::NULL_LITERAL:
+            return make<AST::Literal>(Value(nullptr));
+        default:
+            throw std::runtime_error(std::format("Expected a literal, got {}", token.to_string()));
+        }
     }
 
-    std::shared_ptr<AST::VariableAssignment> Parser::parse_variable_assignment()
+    AST::ExpressionStatement* Parser::parse_expression_statement()
     {
-        not_implemented();
+        auto expression = parse_expression();
+        consume_semicolon_if_exists();
+        return make<AST::ExpressionStatement>(expression);
     }
-    std::shared_ptr<AST::VariableDeclaration> Parser::parse_variable_declaration()
+
+    std::span<AST::Parameter* const> Parser::parse_parameters()
     {
-        not_implemented();
+        const auto base = m_parameter_scratch.size();
+        while(peek().type != TokenType::RIGHT_PAREN && peek().type != TokenType::END_OF_FILE)
+        {
+            m_parameter_scratch.push_back(make<AST::Parameter>(consume(TokenType::IDENTIFIER).atom()));
+            if(peek().type != TokenType::RIGHT_PAREN)
+            {
+                consume(TokenType::COMMA);
+            }
+        }
+
+        return take_scratch(m_parameter_scratch, base);
     }
-    std::shared_ptr<AST::IfStatement> Parser::parse_if_statement()
+
+    AST::VariableDeclaration* Parser::parse_variable_declaration()
     {
-        not_implemented();
+        using DeclarationKind = AST::VariableDeclaration::DeclarationKind;
+        const auto keyword = consume();
+        const auto declaration_kind = keyword.type == TokenType::VAR ? DeclarationKind::VAR
+                                    : keyword.type == TokenType::LET ? DeclarationKind::LET
+                                    : DeclarationKind::CONST;
+        const auto name = consume(TokenType::IDENTIFIER).atom();
+
+        AST::Expression* initial_value = nullptr;
+        if(match(TokenType::EQUALS))
+        {
+            consume();
+            initial_value = parse_expression();
+        }
+
+        consume_semicolon_if_exists();
+        return make<AST::VariableDeclaration>(declaration_kind, name, initial_value);
     }
-    std::shared_ptr<AST::WhileStatement> Parser::parse_while_statement()
+    AST::Statement* Parser::parse_if_statement()
     {
-        not_implemented();
+        consume(TokenType::IF);
+        consume(TokenType::LEFT_PAREN);
+        auto condition = parse_expression();
+        consume(TokenType::RIGHT_PAREN);
+        auto body = parse_body();
+
+        AST::BlockStatement* alternate = nullptr;
+        if(match(TokenType::ELSE))
+        {
+            consume();
+            alternate = parse_body();
+        }
+
+        // The branch that can't run is dropped, unless it declares a var: that still hoists into the function
+        if(m_options.fold_constants && condition->kind() == AST::Kind::LITERAL)
+        {
+            if(Operations::to_boolean(static_cast<const AST::Literal&>(*condition).value()))
+            {
+                if(!alternate || !declares_var(*alternate))
+                {
+                    return body;
+                }
+            } else if(!declares_var(*body))
+            {
+                return alternate;
+            }
+        }
+
+        return make<AST::IfStatement>(condition, body, alternate);
     }
-    std::shared_ptr<AST::ForStatement> Parser::parse_for_statement()
+    AST::Statement* Parser::parse_while_statement()
     {
-        not_implemented();
+        consume(TokenType::WHILE);
+        consume(TokenType::LEFT_PAREN);
+        auto condition = parse_expression();
+        consume(TokenType::RIGHT_PAREN);
+        auto body = parse_body();
+
+        if(m_options.fold_constants && condition->kind() == AST::Kind::LITERAL
+            && !Operations::to_boolean(static_cast<const AST::Literal&>(*condition).value()) && !declares_var(*body))
+        {
+            return nullptr;
+        }
+
+        return make<AST::WhileStatement>(condition, body);
     }
-    std::shared_ptr<AST::ReturnStatement> Parser::parse_return_statement()
+    AST::ForStatement* Parser::parse_for_statement()
     {
         not_implemented();
     }
+    AST::ReturnStatement* Parser::parse_return_statement()
+    {
+        consume(TokenType::RETURN);
+
+        AST::Expression* value = nullptr;
+        if(!match_any(TokenSet(TokenType::SEMICOLON, TokenType::RIGHT_CURLY_BRACE, TokenType::END_OF_FILE)))
+        {
+            value = parse_expression();
+        }
+
+        consume_semicolon_if_exists();
+        return make<AST::ReturnStatement>(value);
+    }
 }
@@ -0,0 +1,286 @@
+#include "Resolver.h"
+
+#include <algorithm>
+
+namespace JS
+{
+    namespace
+    {
+        // The tree hands its children out as const; the resolver is the pass that annotates them in place
+        template <typename T>
+        T& annotate(const T& node)
+        {
+            return const_cast<T&>(node);
+        }
+
+        bool declares_lexically(const AST::Statement& statement)
+        {
+            if(statement.kind() == AST::Kind::FUNCTION_DECLARATION)
+            {
+                return true;
+            }
+
+            return statement.kind() == AST::Kind::VARIABLE_DECLARATION
+                && static_cast<const AST::VariableDeclaration&>(statement).declaration_kind() != AST::VariableDeclaration::DeclarationKind::VAR;
+        }
+    }
+
+    void Resolver::resolve(const AST& ast)
+    {
+        Resolver(*ast.arena()).resolve_program(*ast.program());
+    }
+
+    void Resolver::resolve_program(AST::Program& program)
+    {
+        auto* global_scope = m_arena.make<ScopeInfo>(ScopeInfo::Kind::GLOBAL, nullptr);
+        program.set_scope(global_scope);
+
+        declare_hoisted(program.statements(), *global_scope, *global_scope);
+        resolve_statements(program.statements(), *global_scope);
+    }
+
+    void Resolver::resolve_function(const AST::FunctionDeclaration& function)
+    {
+        resolve_function_body(function);
+    }
+
+    void Resolver::declare_hoisted(const std::span<AST::Statement* const> statements, ScopeInfo& var_scope, ScopeInfo& lexical_scope)
+    {
+        for(const auto* statement : statements)
+        {
+            switch(statement->kind())
+            {
+            case AST::Kind::VARIABLE_DECLARATION:
+            {
+                const auto& declaration = static_cast<const AST::VariableDeclaration&>(*statement);
+                if(declaration.declaration_kind() == AST::VariableDeclaration::DeclarationKind::VAR)
+                {
+                    var_scope.declare(declaration.name());
+                } else
+                {
+                    lexical_scope.declare(declaration.name());
+                }
+                break;
+            }
+            case AST::Kind::FUNCTION_DECLARATION:
+                lexical_scope.declare(static_cast<const AST::FunctionDeclaration&>(*statement).name());
+                break;
+            case AST::Kind::BLOCK_STATEMENT:
+                declare_vars(static_cast<const AST::BlockStatement&>(*statement), var_scope);
+                break;
+            case AST::Kind::IF_STATEMENT:
+            {
+                const auto& if_statement = static_cast<const AST::IfStatement&>(*statement);
+                declare_vars(if_statement.body(), var_scope);
+                if(if_statement.alternate())
+                {
+                    declare_vars(*if_statement.alternate(), var_scope);
+                }
+                break;
+            }
+            case AST::Kind::WHILE_STATEMENT:
+                declare_vars(static_cast<const AST::WhileStatement&>(*statement).body(), var_scope);
+                break;
+            case AST::Kind::FOR_STATEMENT:
+                declare_vars(static_cast<const AST::ForStatement&>(*statement).body(), var_scope);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void Resolver::declare_vars(const AST::BlockStatement& block, ScopeInfo& var_scope)
+    {
+        // A nested block's lexical declarations belong to the block's own scope, made when it is resolved; only its
+        // vars escape to the function. Declaring those into a throwaway scope keeps declare_hoisted's walk in one place
+        ScopeInfo block_scope(ScopeInfo::Kind::BLOCK, nullptr);
+        declare_hoisted(block.statements(), var_scope, block_scope);
+    }
+
+    void Resolver::resolve_statements(const std::span<AST::Statement* const> statements, ScopeInfo& scope)
+    {
+        for(const auto* statement : statements)
+        {
+            switch(statement->kind())
+            {
+            case AST::Kind::VARIABLE_DECLARATION:
+            {
+                auto& declaration = annotate(static_cast<const AST::VariableDeclaration&>(*statement));
+                declaration.set_location(lookup(declaration.name(), scope));
+                if(declaration.initial_value())
+                {
+                    resolve_expression(declaration.initial_value(), scope);
+                }
+                break;
+            }
+            case AST::Kind::FUNCTION_DECLARATION:
+                resolve_function_declaration(static_cast<const AST::FunctionDeclaration&>(*statement), scope);
+                break;
+            case AST::Kind::BLOCK_STATEMENT:
+                resolve_block(static_cast<const AST::BlockStatement&>(*statement), scope);
+                break;
+            case AST::Kind::IF_STATEMENT:
+            {
+                const auto& if_statement = static_cast<const AST::IfStatement&>(*statement);
+                resolve_expression(&if_statement.condition(), scope);
+                resolve_block(if_statement.body(), scope);
+                if(if_statement.alternate())
+                {
+                    resolve_block(*if_statement.alternate(), scope);
+                }
+                break;
+            }
+            case AST::Kind::WHILE_STATEMENT:
+            {
+                const auto& while_statement = static_cast<const AST::WhileStatement&>(*statement);
+                resolve_expression(&while_statement.condition(), scope);
+                resolve_block(while_statement.body(), scope);
+                break;
+            }
+            case AST::Kind::FOR_STATEMENT:
+            {
+                const auto& for_statement = static_cast<const AST::ForStatement&>(*statement);
+                resolve_expression(&for_statement.condition(), scope);
+                resolve_block(for_statement.body(), scope);
+                break;
+            }
+            case AST::Kind::RETURN_STATEMENT:
+                if(const auto* value = static_cast<const AST::ReturnStatement&>(*statement).value())
+                {
+                    resolve_expression(value, scope);
+                }
+                break;
+            case AST::Kind::EXPRESSION_STATEMENT:
+                resolve_expression(&static_cast<const AST::ExpressionStatement&>(*statement).expression(), scope);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void Resolver::resolve_block(const AST::BlockStatement& block, ScopeInfo& scope)
+    {
+        // Blocks without lexical declarations don't get a runtime scope, so they don't cost a hop either
+        const auto statements = block.statements();
+        if(std::ranges::none_of(statements, [](const AST::Statement* statement) { return declares_lexically(*statement); }))
+        {
+            resolve_statements(statements, scope);
+            return;
+        }
+
+        auto* block_scope = m_arena.make<ScopeInfo>(ScopeInfo::Kind::BLOCK, &scope);
+        annotate(block).set_scope(block_scope);
+        for(const auto* statement : statements)
+        {
+            if(declares_lexically(*statement))
+            {
+                block_scope->declare(statement->kind() == AST::Kind::FUNCTION_DECLARATION
+                    ? static_cast<const AST::FunctionDeclaration&>(*statement).name()
+                    : static_cast<const AST::VariableDeclaration&>(*statement).name());
+            }
+        }
+        resolve_statements(statements, *block_scope);
+    }
+
+    void Resolver::resolve_function_declaration(const AST::FunctionDeclaration& function, ScopeInfo& scope)
+    {
+        auto& declaration = annotate(function);
+        declaration.set_location(lookup(function.name(), scope));
+        declaration.set_enclosing_scope(&scope);
+
+        if(!function.is_body_parsed())
+        {
+            for(const auto name : function.free_names())
+            {
+                lookup(name, scope, true);
+            }
+            return;
+        }
+
+        resolve_function_body(function);
+    }
+
+    void Resolver::resolve_function_body(const AST::FunctionDeclaration& function)
+    {
+        auto* function_scope = m_arena.make<ScopeInfo>(ScopeInfo::Kind::FUNCTION, function.enclosing_scope());
+        annotate(function).set_scope(function_scope);
+        for(const auto* parameter : function.parameters())
+        {
+            function_scope->declare(parameter->name());
+        }
+
+        const auto statements = function.body()->statements();
+        declare_hoisted(statements, *function_scope, *function_scope);
+        resolve_statements(statements, *function_scope);
+    }
+
+    void Resolver::resolve_expression(const AST::Expression* expression, ScopeInfo& scope)
+    {
+        const auto base = m_expression_stack.size();
+        m_expression_stack.push_back(expression);
+        while(m_expression_stack.size() > base)
+        {
+            const auto* current = m_expression_stack.back();
+            m_expression_stack.pop_back();
+            switch(current->kind())
+            {
+            case AST::Kind::VARIABLE_EXPRESSION:
+            {
+                auto& variable = annotate(static_cast<const AST::VariableExpression&>(*current));
+                variable.set_location(lookup(variable.name(), scope));
+                break;
+            }
+            case AST::Kind::VARIABLE_ASSIGNMENT:
+            {
+                auto& assignment = annotate(static_cast<const AST::VariableAssignment&>(*current));
+                assignment.set_location(lookup(assignment.name(), scope));
+                m_expression_stack.push_back(&assignment.value());
+                break;
+            }
+            case AST::Kind::FUNCTION_CALL:
+            {
+                auto& call = annotate(static_cast<const AST::FunctionCall&>(*current));
+                call.set_location(lookup(call.name(), scope));
+                m_expression_stack.insert(m_expression_stack.end(), call.arguments().begin(), call.arguments().end());
+                break;
+            }
+            case AST::Kind::BINARY_EXPRESSION:
+            {
+                const auto& binary = static_cast<const AST::BinaryExpression&>(*current);
+                m_expression_stack.push_back(&binary.left());
+                m_expression_stack.push_back(&binary.right());
+                break;
+            }
+            case AST::Kind::UNARY_EXPRESSION:
+                m_expression_stack.push_back(&static_cast<const AST::UnaryExpression&>(*current).operand());
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    VariableLocation Resolver::lookup(const Atom name, ScopeInfo& scope, bool from_nested_function)
+    {
+        uint32_t hops = 0;
+        for(auto* current = &scope; current; current = current->parent())
+        {
+            if(const auto slot = current->find(name))
+            {
+                if(from_nested_function)
+                {
+                    current->mark_captured(*slot);
+                }
+                return {hops, *slot};
+            }
+
+            // Looking further out than the scope of the function we started in means the reference closes over it
+            from_nested_function |= current->kind() == ScopeInfo::Kind::FUNCTION;
+            ++hops;
+        }
+
+        return {};
+    }
+}
@@ -0,0 +1,152 @@
+#include "SourceBuffer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace JS
+{
+    namespace
+    {
+        std::runtime_error load_error(const std::string& path)
+        {
+            return std::runtime_error("Failed to load " + path + ": " + std::strerror(errno));
+        }
+    }
+
+#if !defined(_WIN32)
+    SourceBuffer SourceBuffer::load(const std::string& path)
+    {
+        SourceBuffer buffer;
+
+        const int fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw load_error(path);
+        }
+
+        struct stat info {};
+        if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                // The lexer makes one front-to-back pass
+                ::madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+                buffer.m_mapping = static_cast<const char*>(mapping);
+                buffer.m_size = static_cast<size_t>(info.st_size);
+            }
+        }
+
+        if (!buffer.m_mapping)
+        {
+            // Not mappable (pipe, tty, empty or special file): read until EOF
+            size_t used = 0;
+            buffer.m_buffer.resize(64 * 1024);
+            while (true)
+            {
+                if (used == buffer.m_buffer.size())
+                {
+                    buffer.m_buffer.resize(buffer.m_buffer.size() * 2);
+                }
+
+                const ssize_t count = ::read(fd, buffer.m_buffer.data() + used, buffer.m_buffer.size() - used);
+                if (count == 0)
+                {
+                    break;
+                }
+                if (count < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (fd != STDIN_FILENO)
+                    {
+                        ::close(fd);
+                    }
+                    throw load_error(path);
+                }
+                used += static_cast<size_t>(count);
+            }
+            buffer.m_buffer.resize(used);
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        if (fd != STDIN_FILENO)
+        {
+            ::close(fd);
+        }
+        return buffer;
+    }
+
+    void SourceBuffer::release()
+    {
+        if (m_mapping)
+        {
+            ::munmap(const_cast<char*>(m_mapping), m_size);
+            m_mapping = nullptr;
+            m_size = 0;
+        }
+    }
+#else
+    SourceBuffer SourceBuffer::load(const std::string& path)
+    {
+        SourceBuffer buffer;
+
+        std::FILE* file = path == "-" ? stdin : std::fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            throw load_error(path);
+        }
+
+        char chunk[64 * 1024];
+        size_t count;
+        while ((count = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+        {
+            buffer.m_buffer.insert(buffer.m_buffer.end(), chunk, chunk + count);
+        }
+
+        if (file != stdin)
+        {
+            std::fclose(file);
+        }
+        return buffer;
+    }
+
+    void SourceBuffer::release() {}
+#endif
+
+    SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept
+        : m_mapping(std::exchange(other.m_mapping, nullptr)),
+          m_size(std::exchange(other.m_size, 0)),
+          m_buffer(std::move(other.m_buffer))
+    {
+    }
+
+    SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            m_mapping = std::exchange(other.m_mapping, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+            m_buffer = std::move(other.m_buffer);
+        }
+        return *this;
+    }
+
+    SourceBuffer::~SourceBuffer()
+    {
+        release();
+    }
+}
@@ -0,0 +1,54 @@
+#include "ThreadPool.h"
+
+namespace JS
+{
+    ThreadPool::ThreadPool(const size_t thread_count)
+    {
+        m_workers.reserve(thread_count);
+        for (size_t i = 0; i < thread_count; ++i)
+        {
+            m_workers.emplace_back([this] { worker_loop(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::enqueue(std::function<void()> job)
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_jobs.push(std::move(job));
+        }
+        m_wake.notify_one();
+    }
+
+    void ThreadPool::worker_loop()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(m_mutex);
+                m_wake.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty())
+                {
+                    return;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop();
+            }
+            job();
+        }
+    }
+}
@@ -0,0 +1,394 @@
+#include "TokenCache.h"
+
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Log.h"
+
+namespace JS
+{
+    namespace
+    {
+        // Entry layout: header, tokens, numbers, length-prefixed atom names and cooked strings, then a copy of the
+        // source. Identifier, number and cooked string payloads in the stored tokens index the entry's own tables
+        struct EntryHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t token_size;
+            uint64_t source_hash;
+            uint64_t source_size;
+            uint64_t token_count;
+            uint64_t number_count;
+            uint64_t atom_count;
+            uint64_t cooked_count;
+            uint64_t strings_size;
+        };
+
+        static_assert(sizeof(EntryHeader) % alignof(double) == 0);
+        static_assert(sizeof(Token) % alignof(double) == 0);
+
+        constexpr char entry_magic[8] = {'J', 'S', 'T', 'O', 'K', 'E', 'N', 'S'};
+
+        void write_string(std::ofstream& out, const std::string_view string)
+        {
+            const auto length = static_cast<uint32_t>(string.size());
+            out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.write(string.data(), static_cast<std::streamsize>(string.size()));
+        }
+
+        // Reads one length-prefixed string out of the strings section, or nothing if the entry is truncated
+        std::optional<std::string_view> read_string(const char*& cursor, const char* const end)
+        {
+            uint32_t length;
+            if (end - cursor < static_cast<ptrdiff_t>(sizeof(length)))
+            {
+                return std::nullopt;
+            }
+            std::memcpy(&length, cursor, sizeof(length));
+            cursor += sizeof(length);
+            if (static_cast<size_t>(end - cursor) < length)
+            {
+                return std::nullopt;
+            }
+            const std::string_view string{cursor, length};
+            cursor += length;
+            return string;
+        }
+    }
+
+    std::optional<std::filesystem::path> TokenCache::default_directory()
+    {
+        if (const char* directory = std::getenv("JS_CACHE_DIR"); directory && *directory)
+        {
+            return std::filesystem::path{directory};
+        }
+        return std::nullopt;
+    }
+
+    uint64_t TokenCache::hash(const std::span<const char> bytes)
+    {
+        // Eight bytes per step multiply-rotate mixing. Not cryptographic: it only picks the entry, load() compares
+        // the source copy in it against the file before trusting it
+        constexpr uint64_t prime_1 = 0x9E3779B97F4A7C15ull;
+        constexpr uint64_t prime_2 = 0xC2B2AE3D27D4EB4Full;
+
+        uint64_t hash = bytes.size() * prime_1;
+        size_t i = 0;
+        for (; i + 8 <= bytes.size(); i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes.data() + i, sizeof(word));
+            hash = std::rotl(hash ^ (word * prime_2), 31) * prime_1;
+        }
+
+        uint64_t tail = 0;
+        std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+        hash = std::rotl(hash ^ (tail * prime_2), 31) * prime_1;
+
+        hash ^= hash >> 33;
+        hash *= prime_2;
+        hash ^= hash >> 29;
+        return hash;
+    }
+
+    std::filesystem::path TokenCache::entry_path(const uint64_t source_hash) const
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "%016llx-v%u.tokens", static_cast<unsigned long long>(source_hash), token_cache_version);
+        return m_directory / name;
+    }
+
+#if !defined(_WIN32)
+    void TokenCache::store(const FileId file_id, const std::span<const Token> tokens) const
+    {
+        const auto& file = FileTable::the().file(file_id);
+
+        // Rewrite payloads to point into tables local to the entry
+        std::vector<Token> stored(tokens.begin(), tokens.end());
+        std::unordered_map<uint32_t, uint32_t> atom_ids;
+        std::vector<std::string_view> atoms;
+        std::vector<double> numbers;
+        std::vector<std::string_view> cooked_strings;
+        for (auto& token : stored)
+        {
+            token.file_id = 0;
+            if (token.type == TokenType::IDENTIFIER)
+            {
+                const auto [entry, inserted] = atom_ids.emplace(token.payload, static_cast<uint32_t>(atoms.size()));
+                if (inserted)
+                {
+                    atoms.push_back(token.atom().name());
+                }
+                token.payload = entry->second;
+            }
+            else if (token.type == TokenType::NUMBER && !(token.flags & Token::SMALL_INTEGER))
+            {
+                numbers.push_back(file.payloads.numbers[token.payload]);
+                token.payload = static_cast<uint32_t>(numbers.size() - 1);
+            }
+            else if (token.flags & Token::COOKED_STRING)
+            {
+                cooked_strings.emplace_back(file.payloads.cooked_strings[token.payload]);
+                token.payload = static_cast<uint32_t>(cooked_strings.size() - 1);
+            }
+        }
+
+        uint64_t strings_size = 0;
+        for (const auto& string : atoms)
+        {
+            strings_size += sizeof(uint32_t) + string.size();
+        }
+        for (const auto& string : cooked_strings)
+        {
+            strings_size += sizeof(uint32_t) + string.size();
+        }
+
+        EntryHeader header{};
+        std::memcpy(header.magic, entry_magic, sizeof(entry_magic));
+        header.version = token_cache_version;
+        header.token_size = sizeof(Token);
+        header.source_hash = hash(file.source);
+        header.source_size = file.source.size();
+        header.token_count = stored.size();
+        header.number_count = numbers.size();
+        header.atom_count = atoms.size();
+        header.cooked_count = cooked_strings.size();
+        header.strings_size = strings_size;
+
+        // Write to a uniquely named file next to the entry and rename it into place, so a concurrent reader never
+        // sees a partial entry and concurrent writers never share a file
+        const auto path = entry_path(header.source_hash);
+        std::error_code error;
+        std::filesystem::create_directories(m_directory, error);
+        std::string temporary = path.string() + ".XXXXXX";
+        if (const int fd = ::mkstemp(temporary.data()); fd >= 0)
+        {
+            ::close(fd);
+        }
+        else
+        {
+            Log::the().debug("Failed to create a token cache entry in ", m_directory);
+            return;
+        }
+
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(stored.data()), static_cast<std::streamsize>(stored.size() * sizeof(Token)));
+            out.write(reinterpret_cast<const char*>(numbers.data()), static_cast<std::streamsize>(numbers.size() * sizeof(double)));
+            for (const auto& string : atoms)
+            {
+                write_string(out, string);
+            }
+            for (const auto& string : cooked_strings)
+            {
+                write_string(out, string);
+            }
+            out.write(file.source.data(), static_cast<std::streamsize>(file.source.size()));
+
+            if (!out)
+            {
+                Log::the().debug("Failed to write token cache entry ", temporary);
+                std::filesystem::remove(temporary, error);
+                return;
+            }
+        }
+
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+        {
+            Log::the().debug("Failed to write token cache entry ", path, ": ", error.message());
+            std::filesystem::remove(temporary, error);
+        }
+    }
+
+    std::optional<CachedTokens> TokenCache::load(const FileId file_id) const
+    {
+        auto& file = FileTable::the().file(file_id);
+        const uint64_t source_hash = hash(file.source);
+
+        const int fd = ::open(entry_path(source_hash).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return std::nullopt;
+        }
+
+        struct stat info {};
+        if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(EntryHeader))
+        {
+            ::close(fd);
+            return std::nullopt;
+        }
+
+        // Private and writable: payloads are patched in place, which only copies the pages that are touched
+        const auto size = static_cast<size_t>(info.st_size);
+        void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return std::nullopt;
+        }
+        CachedTokens cached(mapping, size, {});
+
+        // Anything that doesn't add up is treated as a miss, the entry will be overwritten by the next store()
+        EntryHeader header;
+        std::memcpy(&header, mapping, sizeof(header));
+        if (std::memcmp(header.magic, entry_magic, sizeof(entry_magic)) != 0
+            || header.version != token_cache_version
+            || header.token_size != sizeof(Token)
+            || header.source_hash != source_hash
+            || header.source_size != file.source.size()
+            || header.token_count == 0)
+        {
+            return std::nullopt;
+        }
+
+        if (size - sizeof(EntryHeader) < header.source_size)
+        {
+            return std::nullopt;
+        }
+        const size_t available = size - sizeof(EntryHeader) - header.source_size;
+        if (header.token_count > available / sizeof(Token)
+            || header.number_count > (available - header.token_count * sizeof(Token)) / sizeof(double)
+            || header.strings_size != available - header.token_count * sizeof(Token) - header.number_count * sizeof(double))
+        {
+            return std::nullopt;
+        }
+
+        auto* const base = static_cast<char*>(mapping);
+        auto* const tokens = reinterpret_cast<Token*>(base + sizeof(EntryHeader));
+        const auto* const numbers = reinterpret_cast<const double*>(tokens + header.token_count);
+        const char* cursor = reinterpret_cast<const char*>(numbers + header.number_count);
+        const char* const strings_end = cursor + header.strings_size;
+
+        // A different file with the same hash and size would otherwise get its tokens
+        if (std::memcmp(strings_end, file.source.data(), file.source.size()) != 0)
+        {
+            return std::nullopt;
+        }
+
+        std::vector<Atom> atoms;
+        atoms.reserve(header.atom_count);
+        for (uint64_t i = 0; i < header.atom_count; ++i)
+        {
+            const auto name = read_string(cursor, strings_end);
+            if (!name)
+            {
+                return std::nullopt;
+            }
+            atoms.push_back(AtomTable::the().intern(*name));
+        }
+
+        std::vector<std::string_view> cooked_strings;
+        for (uint64_t i = 0; i < header.cooked_count; ++i)
+        {
+            const auto string = read_string(cursor, strings_end);
+            if (!string)
+            {
+                return std::nullopt;
+            }
+            cooked_strings.push_back(*string);
+        }
+
+        // Validate everything before touching the file's payload tables
+        constexpr auto type_count = std::size(TokenTable::all);
+        for (const auto& token : std::span{tokens, header.token_count})
+        {
+            const bool payload_ok =
+                token.type == TokenType::IDENTIFIER ? token.payload < header.atom_count
+                : token.type == TokenType::NUMBER && !(token.flags & Token::SMALL_INTEGER) ? token.payload < header.number_count
+                : token.flags & Token::COOKED_STRING ? token.payload < header.cooked_count
+                : true;
+            if (static_cast<size_t>(token.type) >= type_count || !payload_ok || token.offset + static_cast<uint64_t>(token.length) > file.source.size())
+            {
+                return std::nullopt;
+            }
+        }
+        if (tokens[header.token_count - 1].type != TokenType::END_OF_FILE)
+        {
+            return std::nullopt;
+        }
+
+        const auto number_base = static_cast<uint32_t>(file.payloads.numbers.size());
+        const auto cooked_base = static_cast<uint32_t>(file.payloads.cooked_strings.size());
+        file.payloads.numbers.insert(file.payloads.numbers.end(), numbers, numbers + header.number_count);
+        file.payloads.cooked_strings.insert(file.payloads.cooked_strings.end(), cooked_strings.begin(), cooked_strings.end());
+
+        for (auto& token : std::span{tokens, header.token_count})
+        {
+            token.file_id = file_id;
+            if (token.type == TokenType::IDENTIFIER)
+            {
+                token.payload = atoms[token.payload].id();
+            }
+            else if (token.type == TokenType::NUMBER && !(token.flags & Token::SMALL_INTEGER))
+            {
+                token.payload += number_base;
+            }
+            else if (token.flags & Token::COOKED_STRING)
+            {
+                token.payload += cooked_base;
+            }
+        }
+
+        cached.m_tokens = {tokens, header.token_count};
+        return cached;
+    }
+
+    CachedTokens::~CachedTokens()
+    {
+        if (m_mapping)
+        {
+            ::munmap(m_mapping, m_size);
+        }
+    }
+#else
+    // Entries are mapped in place, which is only implemented with mmap
+    void TokenCache::store(FileId, std::span<const Token>) const
+    {
+    }
+
+    std::optional<CachedTokens> TokenCache::load(FileId) const
+    {
+        return std::nullopt;
+    }
+
+    CachedTokens::~CachedTokens() = default;
+#endif
+
+    CachedTokens::CachedTokens(void* mapping, const size_t size, const std::span<const Token> tokens)
+        : m_mapping(mapping), m_size(size), m_tokens(tokens)
+    {
+    }
+
+    CachedTokens::CachedTokens(CachedTokens&& other) noexcept
+        : m_mapping(std::exchange(other.m_mapping, nullptr)),
+          m_size(std::exchange(other.m_size, 0)),
+          m_tokens(std::exchange(other.m_tokens, {}))
+    {
+    }
+
+    CachedTokens& CachedTokens::operator=(CachedTokens&& other) noexcept
+    {
+        if (this != &other)
+        {
+            std::swap(m_mapping, other.m_mapping);
+            std::swap(m_size, other.m_size);
+            std::swap(m_tokens, other.m_tokens);
+        }
+        return *this;
+    }
+}
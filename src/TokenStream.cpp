@@ -0,0 +1,18 @@
+#include "TokenStream.h"
+
+namespace JS
+{
+    void TokenStream::fill()
+    {
+        // The lexer has already reported invalid characters, the parser only wants the valid tokens around them.
+        // Past the end of the input the lexer keeps producing END_OF_FILE, so consuming EOF is harmless
+        Token token;
+        do
+        {
+            token = m_lexer->next();
+        } while (token.type == TokenType::INVALID);
+
+        m_ring[(m_head + m_count) & (max_lookahead - 1)] = token;
+        ++m_count;
+    }
+}
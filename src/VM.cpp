@@ -0,0 +1,430 @@
+#include "VM.h"
+
+#include <cmath>
+#include <iostream>
+
+#include "Compiler.h"
+#include "Operations.h"
+
+namespace JS
+{
+    namespace
+    {
+        using Op = AST::BinaryExpression::Op;
+
+        // Everything Operations can't do: the only non-primitive values are functions, which can only be compared
+        Value binary_operation(const Op op, const Value& left, const Value& right)
+        {
+            if(auto result = Operations::binary_operation(op, left, right))
+            {
+                return std::move(*result);
+            }
+
+            const bool same_closure = left.is<Cell>() && right.is<Cell>() && &left.as<Cell>() == &right.as<Cell>();
+            switch(op)
+            {
+            case Op::EQUAL_EQUAL:
+            case Op::EQUAL_EQUAL_EQUAL:
+                return Value(same_closure);
+            case Op::NOT_EQUAL:
+            case Op::NOT_EQUAL_EQUAL:
+                return Value(!same_closure);
+            default:
+                throw std::runtime_error(std::format("Unsupported operands for {}: {} and {}", magic_enum::enum_name(op), left.to_string(), right.to_string()));
+            }
+        }
+
+        Value unary_operation(const AST::UnaryExpression::Op op, const Value& operand)
+        {
+            if(auto result = Operations::unary_operation(op, operand))
+            {
+                return std::move(*result);
+            }
+            if(op == AST::UnaryExpression::Op::NOT)
+            {
+                return Value(false);
+            }
+
+            throw std::runtime_error(std::format("Unsupported operand for unary {}: {}", magic_enum::enum_name(op), operand.to_string()));
+        }
+
+        bool is_truthy(const Value& value)
+        {
+            if(value.is<bool>())
+            {
+                return value.as<bool>();
+            }
+            return Operations::to_boolean(value);
+        }
+    }
+
+    VM::VM()
+    {
+        m_registers.resize(1024);
+
+        CurrentHeap current_heap(m_heap);
+        set_global(AtomTable::the().intern("print"), Value(Value::Function([](const std::span<const Value> arguments)
+        {
+            for(size_t i = 0; i < arguments.size(); ++i)
+            {
+                std::cout << (i ? " " : "") << Operations::to_string(arguments[i]);
+            }
+            std::cout << std::endl;
+            return Value();
+        })));
+    }
+
+    void VM::set_global(const Atom name, Value value)
+    {
+        m_globals.insert_or_assign(name, std::move(value));
+    }
+
+    Value VM::run(const AST& ast)
+    {
+        CurrentHeap current_heap(m_heap);
+        auto& program = *m_programs.emplace_back(Compiler::compile(ast));
+        try
+        {
+            return execute(program, nullptr);
+        }
+        catch(...)
+        {
+            m_frames.clear();
+            throw;
+        }
+    }
+
+    void VM::collect_garbage()
+    {
+        m_heap.collect([this](Tracer& tracer)
+        {
+            // Registers past the innermost frame's are left over from returned calls and are never read again
+            // before a call overwrites them, so they are no roots; what they point to may already be freed
+            const auto live_registers = m_frames.empty() ? 0 : m_frames.back().base + m_frames.back().function->register_count;
+            for(size_t i = 0; i < live_registers; ++i)
+            {
+                tracer.visit(m_registers[i]);
+            }
+            for(auto& frame : m_frames)
+            {
+                tracer.visit(frame.scope);
+            }
+            for(auto& [name, value] : m_globals)
+            {
+                tracer.visit(value);
+            }
+        });
+    }
+
+    // Handlers are written once and wired up by these: with JS_THREADED_DISPATCH each one ends by jumping straight
+    // to the handler of the next instruction (GCC and Clang's labels as values), otherwise they are the cases of a
+    // switch in a loop
+#ifdef JS_THREADED_DISPATCH
+#define HANDLER(name) handler_##name:
+#define DISPATCH() goto *(static_cast<char*>(&&handler_LOAD_CONSTANT) + static_cast<int32_t>(*pc++))
+#else
+#define HANDLER(name) case Opcode::name:
+#define DISPATCH() break
+#endif
+
+    Value VM::execute(FunctionCode& function, Scope* scope)
+    {
+#ifdef JS_THREADED_DISPATCH
+        // Each handler's offset from the first, by opcode. Threaded code has these in place of its opcodes, so
+        // dispatching doesn't need a table lookup; the offsets fit an instruction word where addresses wouldn't
+        static const int32_t handler_offsets[] = {
+#define OPCODE(name, operands) static_cast<int32_t>(static_cast<char*>(&&handler_##name) - static_cast<char*>(&&handler_LOAD_CONSTANT)),
+            ENUMERATE_OPCODES(OPCODE)
+#undef OPCODE
+        };
+        const auto code_of = [](FunctionCode& function)
+        {
+            if(function.threaded_code.empty())
+            {
+                function.threaded_code = function.code;
+                for(size_t offset = 0; offset < function.code.size(); offset += 1 + opcode_operand_counts[function.code[offset]])
+                {
+                    function.threaded_code[offset] = static_cast<uint32_t>(handler_offsets[function.code[offset]]);
+                }
+            }
+            return function.threaded_code.data();
+        };
+#else
+        const auto code_of = [](const FunctionCode& function) { return function.code.data(); };
+#endif
+
+        const auto entry_depth = m_frames.size();
+        const auto entry_base = m_frames.empty() ? 0 : m_frames.back().base + m_frames.back().function->register_count;
+        if(m_registers.size() < entry_base + function.register_count)
+        {
+            m_registers.resize(std::max(2 * m_registers.size(), entry_base + function.register_count));
+        }
+        std::fill_n(m_registers.begin() + static_cast<ptrdiff_t>(entry_base), function.register_count, Value());
+        m_frames.push_back({&function, nullptr, entry_base, scope, 0});
+
+        // The running frame's state, kept in locals; everything in it is reloaded when a call or a return switches
+        // frames
+        auto* frame = &m_frames.back();
+        auto* registers = &m_registers[frame->base];
+        const auto* code = code_of(function);
+        const auto* constants = frame->function->constants.data();
+        const auto* pc = code;
+        Value return_value;
+
+        const auto binary = [&](const Op op)
+        {
+            registers[pc[0]] = binary_operation(op, registers[pc[1]], registers[pc[2]]);
+            pc += 3;
+        };
+        // Numbers skip the type dispatch in Operations
+        const auto arithmetic = [&](const Op op, auto number_operation)
+        {
+            const auto& left = registers[pc[1]];
+            const auto& right = registers[pc[2]];
+            if(left.is_number() && right.is_number())
+            {
+                registers[pc[0]] = Value(number_operation(left.as<double>(), right.as<double>()));
+                pc += 3;
+                return;
+            }
+            binary(op);
+        };
+
+#ifdef JS_THREADED_DISPATCH
+        DISPATCH();
+#else
+        while(true)
+        {
+            switch(static_cast<Opcode>(*pc++))
+            {
+#endif
+            HANDLER(LOAD_CONSTANT)
+                registers[pc[0]] = constants[pc[1]];
+                pc += 2;
+                DISPATCH();
+            HANDLER(LOAD_UNDEFINED)
+                registers[pc[0]] = Value();
+                pc += 1;
+                DISPATCH();
+            HANDLER(MOVE)
+                registers[pc[0]] = registers[pc[1]];
+                pc += 2;
+                DISPATCH();
+            HANDLER(GET_SCOPE)
+            {
+                auto* scope = frame->scope;
+                for(uint32_t hops = pc[1]; hops > 0; --hops)
+                {
+                    scope = scope->parent();
+                }
+                registers[pc[0]] = scope->slot(pc[2]);
+                pc += 3;
+                DISPATCH();
+            }
+            HANDLER(SET_SCOPE)
+            {
+                auto* scope = frame->scope;
+                for(uint32_t hops = pc[0]; hops > 0; --hops)
+                {
+                    scope = scope->parent();
+                }
+                scope->set_slot(m_heap, pc[1], registers[pc[2]]);
+                pc += 3;
+                DISPATCH();
+            }
+            HANDLER(GET_GLOBAL)
+            {
+                const auto global = m_globals.find(Atom(pc[1]));
+                if(global == m_globals.end())
+                {
+                    throw std::runtime_error(std::format("{} is not defined", Atom(pc[1]).name()));
+                }
+                registers[pc[0]] = global->second;
+                pc += 2;
+                DISPATCH();
+            }
+            HANDLER(SET_GLOBAL)
+                m_globals.insert_or_assign(Atom(pc[0]), registers[pc[1]]);
+                pc += 2;
+                DISPATCH();
+            HANDLER(PUSH_SCOPE)
+                frame->scope = m_heap.allocate<Scope>(frame->scope, pc[0]);
+                pc += 1;
+                DISPATCH();
+            HANDLER(POP_SCOPE)
+                frame->scope = frame->scope->parent();
+                DISPATCH();
+            HANDLER(MAKE_CLOSURE)
+                registers[pc[0]] = Value(m_heap.allocate<Closure>(frame->function->functions[pc[1]].get(), frame->scope));
+                pc += 2;
+                DISPATCH();
+
+            HANDLER(ADD)
+                arithmetic(Op::PLUS, [](const double a, const double b) { return a + b; });
+                DISPATCH();
+            HANDLER(SUBTRACT)
+                arithmetic(Op::MINUS, [](const double a, const double b) { return a - b; });
+                DISPATCH();
+            HANDLER(MULTIPLY)
+                arithmetic(Op::MULT, [](const double a, const double b) { return a * b; });
+                DISPATCH();
+            HANDLER(DIVIDE)
+                arithmetic(Op::DIV, [](const double a, const double b) { return a / b; });
+                DISPATCH();
+            HANDLER(MODULO)
+                arithmetic(Op::MOD, [](const double a, const double b) { return std::fmod(a, b); });
+                DISPATCH();
+            HANDLER(BITWISE_AND)
+                binary(Op::AND);
+                DISPATCH();
+            HANDLER(BITWISE_OR)
+                binary(Op::OR);
+                DISPATCH();
+            HANDLER(BITWISE_XOR)
+                binary(Op::XOR);
+                DISPATCH();
+            HANDLER(SHIFT_LEFT)
+                binary(Op::SHIFT_LEFT);
+                DISPATCH();
+            HANDLER(SHIFT_RIGHT)
+                binary(Op::SHIFT_RIGHT);
+                DISPATCH();
+            HANDLER(LOOSELY_EQUAL)
+                binary(Op::EQUAL_EQUAL);
+                DISPATCH();
+            HANDLER(LOOSELY_NOT_EQUAL)
+                binary(Op::NOT_EQUAL);
+                DISPATCH();
+            HANDLER(STRICTLY_EQUAL)
+                arithmetic(Op::EQUAL_EQUAL_EQUAL, [](const double a, const double b) { return a == b; });
+                DISPATCH();
+            HANDLER(STRICTLY_NOT_EQUAL)
+                arithmetic(Op::NOT_EQUAL_EQUAL, [](const double a, const double b) { return a != b; });
+                DISPATCH();
+            HANDLER(LESS_THAN)
+                arithmetic(Op::LESS_THAN, [](const double a, const double b) { return a < b; });
+                DISPATCH();
+            HANDLER(GREATER_THAN)
+                arithmetic(Op::GREATER_THAN, [](const double a, const double b) { return a > b; });
+                DISPATCH();
+            HANDLER(LESS_THAN_EQUAL_TO)
+                arithmetic(Op::LESS_THAN_EQUAL_TO, [](const double a, const double b) { return a <= b; });
+                DISPATCH();
+            HANDLER(GREATER_THAN_EQUAL_TO)
+                arithmetic(Op::GREATER_THAN_EQUAL_TO, [](const double a, const double b) { return a >= b; });
+                DISPATCH();
+            HANDLER(NEGATE)
+                registers[pc[0]] = registers[pc[1]].is_number() ? Value(-registers[pc[1]].as<double>()) : unary_operation(AST::UnaryExpression::Op::MINUS, registers[pc[1]]);
+                pc += 2;
+                DISPATCH();
+            HANDLER(TO_NUMBER)
+                registers[pc[0]] = unary_operation(AST::UnaryExpression::Op::PLUS, registers[pc[1]]);
+                pc += 2;
+                DISPATCH();
+            HANDLER(NOT)
+                registers[pc[0]] = Value(!is_truthy(registers[pc[1]]));
+                pc += 2;
+                DISPATCH();
+
+            // Every loop jumps back and every recursion calls, so collecting there bounds how much can be allocated
+            // in between. Everything live is in the registers, the frames and the globals at these points
+            HANDLER(JUMP)
+                if(m_heap.should_collect())
+                {
+                    collect_garbage();
+                }
+                pc = code + pc[0];
+                DISPATCH();
+            HANDLER(JUMP_IF_FALSE)
+                pc = is_truthy(registers[pc[0]]) ? pc + 2 : code + pc[1];
+                DISPATCH();
+            HANDLER(CALL)
+            {
+                if(m_heap.should_collect())
+                {
+                    collect_garbage();
+                }
+
+                const auto destination = pc[0];
+                const auto& callee = registers[pc[1]];
+                const auto first_argument = pc[2];
+                const auto argument_count = pc[3];
+                pc += 4;
+
+                if(callee.is<Closure>())
+                {
+                    const auto& closure = callee.as<Closure>();
+                    auto& callee_function = *closure.function;
+                    if(!callee_function.is_compiled())
+                    {
+                        Compiler::compile_function(callee_function);
+                    }
+                    if(m_frames.size() >= max_call_depth)
+                    {
+                        throw std::runtime_error("Maximum call stack size exceeded");
+                    }
+
+                    // Growing the register file moves it, callee points into it
+                    auto* callee_scope = closure.scope;
+                    const auto base = frame->base + frame->function->register_count;
+                    if(m_registers.size() < base + callee_function.register_count)
+                    {
+                        m_registers.resize(std::max(2 * m_registers.size(), base + callee_function.register_count));
+                        registers = &m_registers[frame->base];
+                    }
+
+                    auto* callee_registers = &m_registers[base];
+                    for(uint32_t i = 0; i < callee_function.register_count; ++i)
+                    {
+                        callee_registers[i] = i < callee_function.parameter_count && i < argument_count ? registers[first_argument + i] : Value();
+                    }
+
+                    frame->pc = pc;
+                    m_frames.push_back({&callee_function, nullptr, base, callee_scope, destination});
+                    frame = &m_frames.back();
+                    registers = callee_registers;
+                    code = code_of(callee_function);
+                    constants = callee_function.constants.data();
+                    pc = code;
+                    DISPATCH();
+                }
+
+                if(callee.is<NativeFunctionCell>())
+                {
+                    registers[destination] = callee.as<NativeFunctionCell>().function(std::span(registers + first_argument, argument_count));
+                    DISPATCH();
+                }
+
+                throw std::runtime_error(std::format("{} is not a function", callee.to_string()));
+            }
+            HANDLER(RETURN)
+                return_value = std::move(registers[pc[0]]);
+                goto leave_frame;
+            HANDLER(RETURN_UNDEFINED)
+                return_value = Value();
+            leave_frame:
+            {
+                const auto return_register = frame->return_register;
+                m_frames.pop_back();
+                if(m_frames.size() == entry_depth)
+                {
+                    return return_value;
+                }
+
+                frame = &m_frames.back();
+                registers = &m_registers[frame->base];
+                code = code_of(*frame->function);
+                constants = frame->function->constants.data();
+                pc = frame->pc;
+                registers[return_register] = std::move(return_value);
+                DISPATCH();
+            }
+#ifndef JS_THREADED_DISPATCH
+            }
+        }
+#endif
+    }
+
+#undef HANDLER
+#undef DISPATCH
+}
@@ -0,0 +1,45 @@
+#include "Value.h"
+
+#include "Heap.h"
+
+namespace JS
+{
+    namespace
+    {
+        Heap& current_heap()
+        {
+            auto* heap = Heap::current();
+            if(!heap)
+            {
+                throw std::runtime_error("No heap to allocate in");
+            }
+            return *heap;
+        }
+    }
+
+    Value::Value(std::string string)
+    {
+        auto* heap = Heap::current();
+        *this = heap ? Value(heap->allocate<StringCell>(std::move(string))) : Value(AtomTable::the().intern(string));
+    }
+
+    Value::Value(Array array) : Value(current_heap().allocate<ArrayCell>(std::move(array))) {}
+    Value::Value(Object object) : Value(current_heap().allocate<ObjectCell>(std::move(object))) {}
+    Value::Value(Function function) : Value(current_heap().allocate<NativeFunctionCell>(std::move(function))) {}
+
+    void ArrayCell::visit_edges(Tracer& tracer)
+    {
+        for(auto& element : elements)
+        {
+            tracer.visit(element);
+        }
+    }
+
+    void ObjectCell::visit_edges(Tracer& tracer)
+    {
+        for(auto& [name, property] : properties)
+        {
+            tracer.visit(property);
+        }
+    }
+}
@@ -1,48 +1,140 @@
 #include <iostream>
-#include <fstream>
+#include <optional>
+#include <string_view>
 
 #include "AST.h"
+#include "errors.h"
 #include "Lexer.h"
 #include "Parser.h"
+#include "Resolver.h"
+#include "SourceBuffer.h"
+#include "TokenCache.h"
+#include "TokenStream.h"
+#include "VM.h"
 
-std::string load_file(const std::string& file_name)
+namespace
 {
-    std::ifstream file(file_name, std::ios_base::in | std::ios_base::ate);
-
-    const size_t file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    std::vector<char> buffer(file_size);
-    file.read(buffer.data(), static_cast<long long>(file_size));
-
-    return {buffer.data(), buffer.size()};
+    std::optional<JS::ParserOptions::FunctionBodies> parse_function_bodies(const std::string_view value)
+    {
+        if (value == "lazy")
+        {
+            return JS::ParserOptions::FunctionBodies::LAZY;
+        }
+        if (value == "eager")
+        {
+            return JS::ParserOptions::FunctionBodies::EAGER;
+        }
+        if (value == "parallel")
+        {
+            return JS::ParserOptions::FunctionBodies::PARALLEL;
+        }
+        return std::nullopt;
+    }
 }
 
 int main(const int argc, char **argv)
 {
-    if(argc != 2)
+    // Function bodies are parsed on first call by default, so a script only pays for the functions it runs.
+    // "parallel" parses every top-level body on the thread pool up front instead, which is faster when most of
+    // them end up being called, "eager" parses them in line
+    constexpr std::string_view function_bodies_flag = "--function-bodies=";
+    JS::ParserOptions options;
+    const char* path = nullptr;
+    bool usage_error = false;
+    for (int i = 1; i < argc; ++i)
     {
-        std::cerr << "Pass file as an argument." << std::endl;
+        const std::string_view argument = argv[i];
+        if (argument.starts_with(function_bodies_flag))
+        {
+            const auto function_bodies = parse_function_bodies(argument.substr(function_bodies_flag.size()));
+            usage_error |= !function_bodies;
+            options.function_bodies = function_bodies.value_or(options.function_bodies);
+        } else
+        {
+            usage_error |= path != nullptr;
+            path = argv[i];
+        }
+    }
+
+    if (usage_error || !path)
+    {
+        std::cerr << "Usage: " << argv[0] << " [--function-bodies=lazy|eager|parallel] file" << std::endl;
         return EXIT_FAILURE;
     }
 
     Log::the().set_level(Log::Level::INFO);
 
-    auto file_string = load_file(argv[1]);
+    std::optional<JS::SourceBuffer> source;
+    try
+    {
+        source.emplace(JS::SourceBuffer::load(path));
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    JS::Lexer lexer(file_string);
-    auto tokens = lexer.lex("hello_world.js");
+    const auto file_id = JS::FileTable::the().add(path, std::move(*source));
+    JS::Lexer lexer(file_id);
 
-    // for(auto& token : tokens)
-    // {
-    //     std::cout << token.to_string() << std::endl;
-    // }
+    // Errors from the lexer, parser and resolver are syntax errors, anything once the program runs is uncaught
+    bool running = false;
+    try
+    {
+        // With a cache configured, unchanged scripts reuse the tokens from their last run. Otherwise big inputs (and
+        // anything we're about to cache) are lexed up front, everything else streams straight into the parser
+        std::optional<JS::TokenCache> cache;
+        if (const auto directory = JS::TokenCache::default_directory())
+        {
+            cache.emplace(*directory);
+        }
+
+        std::optional<JS::CachedTokens> cached = cache ? cache->load(file_id) : std::nullopt;
+        std::vector<JS::Token> pre_lexed;
+        if (!cached && (cache || lexer.lexes_in_parallel()))
+        {
+            pre_lexed = lexer.lex();
+            // A cache hit wouldn't show the lexer's errors again
+            if (cache && !lexer.reported_errors())
+            {
+                cache->store(file_id, pre_lexed);
+            }
+        }
+
+        JS::TokenStream tokens = cached ? JS::TokenStream(cached->tokens())
+                               : pre_lexed.empty() ? JS::TokenStream(lexer)
+                               : JS::TokenStream(pre_lexed);
 
-    JS::Parser parser(tokens);
-    const JS::AST ast = parser.parse();
+        JS::Parser parser(tokens, options);
+        const JS::AST ast = parser.parse();
+        JS::Resolver::resolve(ast);
 
-    const auto program = ast.program();
-    std::cout << "Parsed program: " << program->to_string() << std::endl;;
+        // The lexer recovers from its errors to report as many as it can, but the program isn't run
+        if (lexer.reported_errors())
+        {
+            return EXIT_FAILURE;
+        }
+
+        if (Log::the().level() <= Log::Level::DEBUG)
+        {
+            Log::the().debug("Parsed program: ", ast.program()->to_string());
+        }
+
+        JS::VM vm;
+        running = true;
+        (void)vm.run(ast);
+    }
+    catch (const JS::InvalidSyntax&)
+    {
+        // The lexer has already logged what and where
+        return EXIT_FAILURE;
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cerr << (running ? "Uncaught error: " : "Syntax error: ") << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
 }
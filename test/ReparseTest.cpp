@@ -0,0 +1,193 @@
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AST.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Resolver.h"
+#include "TokenStream.h"
+#include "VM.h"
+
+// Lexer::relex and Parser::reparse must give what a fresh lex and parse of the edited text gives, for edits before,
+// inside and after a function declaration, and must leave the previous tree as it was, still runnable
+namespace
+{
+    int failures = 0;
+
+    void check(const bool condition, const std::string_view test, const std::string_view what)
+    {
+        if(!condition)
+        {
+            std::cerr << test << ": " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    // The file table only points at sources, they have to outlive every token
+    std::deque<std::string> sources;
+
+    std::span<const char> keep(std::string source)
+    {
+        return sources.emplace_back(std::move(source));
+    }
+
+    const std::string original = "function f(a, b) { return a + b; }\n"
+                                 "var x = 1;\n"
+                                 "function g(n) { function h() { return n; } return h() * x; }\n"
+                                 "print(f(1, 2) + g(3));\n";
+
+    // Every function declared at the top of statements, and in their bodies once parse_bodies has parsed them
+    void collect_functions(const std::span<JS::AST::Statement* const> statements, const bool parse_bodies, std::vector<JS::AST::FunctionDeclaration*>& result)
+    {
+        for(const auto& statement : statements)
+        {
+            if(statement->kind() != JS::AST::Kind::FUNCTION_DECLARATION)
+            {
+                continue;
+            }
+            auto function = static_cast<JS::AST::FunctionDeclaration*>(statement);
+            result.push_back(function);
+            if(parse_bodies || function->is_body_parsed())
+            {
+                collect_functions(function->body()->statements(), parse_bodies, result);
+            }
+        }
+    }
+
+    std::vector<JS::AST::FunctionDeclaration*> functions(const JS::AST& ast, const bool parse_bodies = false)
+    {
+        std::vector<JS::AST::FunctionDeclaration*> result;
+        collect_functions(ast.program()->statements(), parse_bodies, result);
+        return result;
+    }
+
+    // Parses every lazy body first, so the whole tree shows. The file must still hold the text ast was parsed from
+    std::string dump(const JS::AST& ast)
+    {
+        (void)functions(ast, true);
+        return ast.program()->to_string();
+    }
+
+    bool same_tokens(const std::span<const JS::Token> left, const std::span<const JS::Token> right)
+    {
+        if(left.size() != right.size())
+        {
+            return false;
+        }
+        for(size_t i = 0; i < left.size(); ++i)
+        {
+            const auto& a = left[i];
+            const auto& b = right[i];
+            if(a.type != b.type || a.offset != b.offset || a.length != b.length || a.text() != b.text())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // What the program prints, or the error it stops with
+    std::string run(const JS::AST& ast)
+    {
+        std::ostringstream output;
+        auto* const stdout_buffer = std::cout.rdbuf(output.rdbuf());
+        try
+        {
+            JS::VM vm;
+            (void)vm.run(ast);
+        }
+        catch(const std::runtime_error& error)
+        {
+            output << "error: " << error.what();
+        }
+        std::cout.rdbuf(stdout_buffer);
+        return output.str();
+    }
+
+    JS::AST parse(std::vector<JS::Token>& tokens)
+    {
+        JS::TokenStream stream(tokens);
+        JS::Parser parser(stream);
+        auto ast = parser.parse();
+        JS::Resolver::resolve(ast);
+        return ast;
+    }
+
+    void test_edit(const std::string_view test, const std::string_view target, const std::string_view replacement)
+    {
+        const auto id = JS::FileTable::the().add(std::string(test), keep(original));
+        JS::Lexer lexer(id);
+        auto old_tokens = lexer.lex();
+        const auto old_ast = parse(old_tokens);
+        const auto old_dump = dump(old_ast);
+        const auto old_output = run(old_ast);
+        const auto old_functions = functions(old_ast);
+        std::vector<JS::ScopeInfo*> old_scopes;
+        for(const auto& function : old_functions)
+        {
+            old_scopes.push_back(function->enclosing_scope());
+        }
+
+        auto edited = original;
+        const auto start = edited.find(target);
+        edited.replace(start, target.size(), replacement);
+        const JS::TextEdit edit{static_cast<uint32_t>(start), static_cast<uint32_t>(target.size()), static_cast<uint32_t>(replacement.size())};
+        const auto edited_source = keep(edited);
+        JS::FileTable::the().replace(id, edited_source);
+        auto tokens = JS::Lexer::relex(id, old_tokens, edit);
+
+        const auto fresh_id = JS::FileTable::the().add(std::string(test) + " (fresh)", edited_source);
+        JS::Lexer fresh_lexer(fresh_id);
+        auto fresh_tokens = fresh_lexer.lex();
+        check(same_tokens(tokens, fresh_tokens), test, "relexed tokens differ from a fresh lex");
+
+        JS::TokenStream stream(tokens);
+        JS::Parser parser(stream);
+        const auto ast = parser.reparse(old_ast, edit);
+        JS::Resolver::resolve(ast);
+        const auto fresh_ast = parse(fresh_tokens);
+
+        const auto new_functions = functions(ast, true);
+        const auto fresh_functions = functions(fresh_ast, true);
+        check(new_functions.size() == fresh_functions.size(), test, "different number of functions");
+        for(size_t i = 0; i < new_functions.size() && i < fresh_functions.size(); ++i)
+        {
+            check(new_functions[i]->span().start == fresh_functions[i]->span().start && new_functions[i]->span().end == fresh_functions[i]->span().end, test, "function span differs from a fresh parse");
+        }
+        check(dump(ast) == dump(fresh_ast), test, "reparsed tree differs from a fresh parse");
+        check(run(ast) == run(fresh_ast), test, "reparsed program prints something else than a fresh parse");
+
+        for(size_t i = 0; i < old_functions.size(); ++i)
+        {
+            for(const auto& function : new_functions)
+            {
+                const auto shares_parameters = !function->parameters().empty() && function->parameters().data() == old_functions[i]->parameters().data();
+                check(function != old_functions[i] && !shares_parameters, test, "new tree shares a declaration with the old one");
+            }
+            check(old_functions[i]->enclosing_scope() == old_scopes[i], test, "resolving the new tree changed the old one");
+        }
+        check(old_ast.program()->to_string() == old_dump, test, "old tree changed");
+        check(run(old_ast) == old_output, test, "old program prints something else after the edit");
+    }
+}
+
+int main()
+{
+    test_edit("edit before a function", "x = 1", "x = 10");
+    test_edit("edit inside a function", "h() * x", "h() * x * n");
+    test_edit("edit after a function", "g(3)", "g(4) + 1");
+    test_edit("edit renaming a function", "function g", "function gg");
+
+    if(failures)
+    {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,18 @@
+# Runs SCRIPT with the interpreter at JS, passing FLAGS. With EXPECTED set, the script must succeed and print exactly
+# that file; without, it must fail before printing anything itself (the log's own "[error] ..." lines are fine)
+execute_process(COMMAND ${JS} ${FLAGS} ${SCRIPT} OUTPUT_VARIABLE output ERROR_VARIABLE errors RESULT_VARIABLE result)
+
+if(DEFINED EXPECTED)
+    file(READ ${EXPECTED} expected)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${SCRIPT} exited with ${result}:\n${errors}")
+    endif()
+    if(NOT output STREQUAL expected)
+        message(FATAL_ERROR "${SCRIPT} printed:\n${output}\nexpected:\n${expected}")
+    endif()
+else()
+    string(REGEX REPLACE "\\[[a-z]+\\] [^\n]*\n" "" printed "${output}")
+    if(result EQUAL 0 OR NOT printed STREQUAL "")
+        message(FATAL_ERROR "${SCRIPT} should have been rejected before running, exited with ${result} after printing:\n${printed}")
+    endif()
+endif()
@@ -0,0 +1,2 @@
+function f() { let = ; }
+print(1);
@@ -0,0 +1,49 @@
+function counter(start) {
+    let count = start;
+    function next() { count = count + 1; return count; }
+    return next;
+}
+let a = counter(0);
+let b = counter(100);
+a(); a();
+b();
+print("counters", a(), b());
+
+function pair() {
+    var shared = 0;
+    function add(n) { shared += n; return shared; }
+    function get() { return shared; }
+    add(5);
+    return get;
+}
+let get_shared = pair();
+print("shared", get_shared());
+
+function outer(x) {
+    function middle(y) {
+        function inner(z) { return x + y + z; }
+        return inner;
+    }
+    return middle;
+}
+let middle = outer(1);
+let inner = middle(20);
+print("nested", inner(300));
+
+function per_iteration() {
+    let first; let second; let third;
+    let i = 0;
+    while(i < 3) {
+        let captured = i * 10;
+        function get() { return captured; }
+        if(i == 0) { first = get; } else if(i == 1) { second = get; } else { third = get; }
+        i += 1;
+    }
+    print("loop", first(), second(), third());
+}
+per_iteration();
+
+function make_adder(n) { function add(m) { return n + m; } return add; }
+let add2 = make_adder(2);
+let add10 = make_adder(10);
+print("adders", add2(1), add10(1), add2(add10(5)));
@@ -0,0 +1,25 @@
+function fib(n) {
+    if(n < 2) { return n; }
+    return fib(n - 1) + fib(n - 2);
+}
+print("fib", fib(20));
+
+function factorial(n) {
+    if(n <= 1) { return 1; }
+    return n * factorial(n - 1);
+}
+print("factorial", factorial(10));
+
+function is_even(n) { if(n == 0) { return true; } return is_odd(n - 1); }
+function is_odd(n) { if(n == 0) { return false; } return is_even(n - 1); }
+print("mutual", is_even(100), is_odd(7));
+
+function depth(n) { if(n == 0) { return 0; } return 1 + depth(n - 1); }
+print("deep", depth(5000));
+
+function ackermann(m, n) {
+    if(m == 0) { return n + 1; }
+    if(n == 0) { return ackermann(m - 1, 1); }
+    return ackermann(m - 1, ackermann(m, n - 1));
+}
+print("ackermann", ackermann(2, 3));
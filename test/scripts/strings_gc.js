@@ -0,0 +1,31 @@
+// Enough short-lived strings to fill the nursery many times over, while a few of them are kept alive across
+// collections in a local, a global and a closure
+function repeat(piece, n) {
+    let s = "";
+    let i = 0;
+    while(i < n) { s = s + piece; i += 1; }
+    return s;
+}
+
+var kept = "";
+function remember() {
+    let last = "";
+    function set(s) { last = s; return last; }
+    function get() { return last; }
+    set("start");
+    return get;
+}
+let recall = remember();
+
+let round = 0;
+let built = 0;
+while(round < 4000) {
+    let s = repeat("ab", 60);
+    if(round % 1000 == 0) { kept = kept + s; }
+    built += 1;
+    round += 1;
+}
+print("built", built);
+print("kept", kept == repeat("ab", 240));
+print("closure", recall());
+print("mixed", "n=" + 1 + 2, 1 + 2 + "=n", "x" + null + true);